@@ -1,4 +1,10 @@
 
+#ifndef _ATOMIC_H_
+#define _ATOMIC_H_
+
+#ifdef MTX_SIM
+#include "sim.h"
+#else
 #include <sys/atomic.h>
 
 #if defined(__i386__) || defined(__amd64__)
@@ -33,9 +39,13 @@ membar_datadep_consumer(void)
 	__tmp;                                                          \
 })
 
+#endif /* MTX_SIM */
+
 #define KASSERT(c) assert(c)
 #define CACHELINESIZE 64
 
 #ifndef nitems
 #define nitems(_a) (sizeof((_a)) / sizeof((_a)[0]))
 #endif
+
+#endif /* _ATOMIC_H_ */
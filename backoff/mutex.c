@@ -10,13 +10,15 @@
 
 #include <mutex.h>
 #include "../atomic.h"
+#include "../lockstat.h"
+#include "../spin.h"
 
 extern int ncpus;
 
 void
 mtx_init(struct mutex *mtx)
 {
-	mtx->mtx_owner = NULL;
+	mtx->mtx_owner = 0;
 }
 
 int
@@ -26,9 +28,9 @@ mtx_enter_try(struct mutex *mtx)
 	pthread_t owner;
 
 	owner = mtx->mtx_owner;
-	if (owner == NULL) {
-		owner = atomic_cas_ptr(&mtx->mtx_owner, NULL, self);
-		if (owner == NULL) {
+	if (owner == 0) {
+		owner = atomic_cas_ptr(&mtx->mtx_owner, 0, self);
+		if (owner == 0) {
 			membar_enter_after_atomic();
 			return (1);
 		}
@@ -40,20 +42,29 @@ mtx_enter_try(struct mutex *mtx)
 void
 mtx_enter(struct mutex *mtx)
 {
-	unsigned int i, ncycle = 1;
+	unsigned int i, ncycle = 1, maxcycle;
 
-	while (mtx_enter_try(mtx) == 0) {
+	if (mtx_enter_try(mtx)) {
+		LOCKSTAT_INC(LS_FAST);
+		return;
+	}
+
+	maxcycle = ncpus * spin_counts[SPIN_BACKOFF];
+	do {
 		/* Busy loop with exponential backoff. */
-		for (i = ncycle; i > 0; i--)
+		for (i = ncycle; i > 0; i--) {
 			CPU_BUSY_CYCLE();
-		if (ncycle < ncpus)
+			LOCKSTAT_INC(LS_SPINS);
+		}
+		if (ncycle < maxcycle)
 			ncycle += ncycle;
-	}
+	} while (mtx_enter_try(mtx) == 0);
+	LOCKSTAT_INC(LS_SPIN);
 }
 
 void
 mtx_leave(struct mutex *mtx)
 {
 	membar_exit();
-	mtx->mtx_owner = NULL;
+	mtx->mtx_owner = 0;
 }
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <err.h>
+
+#include <pthread.h>
+
+#include "churn.h"
+#include "spin.h"
+
+struct churn churn_conf;
+
+/*
+ * parse burst[,idle=usec][,fresh], eg, "100,idle=50,fresh".
+ */
+
+int
+churn_config(const char *spec)
+{
+	char *list, *item;
+	const char *errstr;
+
+	list = strdup(spec);
+	if (list == NULL)
+		err(1, "churn config");
+
+	churn_conf.c_idle = 10;
+
+	item = strsep(&list, ",");
+	churn_conf.c_burst = strtonum(item, 1, 1000000000, &errstr);
+	if (errstr != NULL) {
+		warnx("churn burst %s: %s", item, errstr);
+		return (-1);
+	}
+
+	while ((item = strsep(&list, ",")) != NULL) {
+		if (strcmp(item, "fresh") == 0) {
+			churn_conf.c_fresh = 1;
+			continue;
+		}
+
+		if (strncmp(item, "idle=", 5) != 0) {
+			warnx("churn %s: expected idle=usec or fresh", item);
+			return (-1);
+		}
+		churn_conf.c_idle = strtonum(item + 5, 0, 1000000, &errstr);
+		if (errstr != NULL) {
+			warnx("churn %s: %s", item, errstr);
+			return (-1);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * stay away from the lock for a while. virtual cpus can't sleep, so
+ * in a simulation they stall instead, which keeps them out of the
+ * way just the same.
+ */
+
+void
+churn_idle(uint64_t *rng)
+{
+	uint64_t ns;
+#ifndef MTX_SIM
+	struct timespec ts;
+#endif
+
+	if (churn_conf.c_idle == 0)
+		return;
+
+	ns = (rng_next(rng) >> 32) % (churn_conf.c_idle * 1000ULL + 1);
+#ifdef MTX_SIM
+	spin_wait(spin_count(ns));
+#else
+	ts.tv_sec = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+void
+churn_print(void)
+{
+	printf("\"churn\":{");
+	printf("\"burst\":%u,", churn_conf.c_burst);
+	printf("\"idle\":%u,", churn_conf.c_idle);
+	printf("\"fresh\":%s", churn_conf.c_fresh ? "true" : "false");
+	printf("}");
+}
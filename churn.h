@@ -0,0 +1,46 @@
+/*
+ * thread churn.
+ *
+ * normally every worker contends for the lock from the start of the
+ * run to the end of it. -C has them come and go instead. each worker
+ * takes the lock a random number of times between 1 and the burst
+ * size, leaves for a random time up to the idle time, and then comes
+ * back for another burst, so the number of threads contending for
+ * the lock keeps changing.
+ *
+ * with fresh, each burst is run by a newly created thread, so locks
+ * that keep queue nodes on the stack or use pthread_self() as the
+ * owner see a different one every time. the worker itself only
+ * waits for the new thread, the way a kernel cpu would keep running
+ * new processes.
+ */
+
+#ifndef _CHURN_H_
+#define _CHURN_H_
+
+#include <stdint.h>
+
+#include "rng.h"
+
+#define CHURN_NSTACKS		4
+#define CHURN_STACKSIZE		(256 * 1024)
+
+struct churn {
+	unsigned int		 c_burst;	/* most acquisitions */
+	unsigned int		 c_idle;	/* longest time away, usec */
+	int			 c_fresh;	/* new thread each burst */
+};
+
+extern struct churn churn_conf;
+
+int	churn_config(const char *);
+void	churn_idle(uint64_t *);
+void	churn_print(void);
+
+static inline uint64_t
+churn_burst(uint64_t *rng)
+{
+	return (1 + (rng_next(rng) >> 32) % churn_conf.c_burst);
+}
+
+#endif /* _CHURN_H_ */
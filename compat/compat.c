@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include <sys/random.h>
+
+#include "compat.h"
+
+#define INVALID		1
+#define TOOSMALL	2
+#define TOOLARGE	3
+
+long long
+strtonum(const char *numstr, long long minval, long long maxval,
+    const char **errstrp)
+{
+	long long ll = 0;
+	int error = 0;
+	char *ep;
+	struct errval {
+		const char *errstr;
+		int err;
+	} ev[4] = {
+		{ NULL,		0 },
+		{ "invalid",	EINVAL },
+		{ "too small",	ERANGE },
+		{ "too large",	ERANGE },
+	};
+
+	ev[0].err = errno;
+	errno = 0;
+	if (minval > maxval) {
+		error = INVALID;
+	} else {
+		ll = strtoll(numstr, &ep, 10);
+		if (numstr == ep || *ep != '\0')
+			error = INVALID;
+		else if ((ll == LLONG_MIN && errno == ERANGE) || ll < minval)
+			error = TOOSMALL;
+		else if ((ll == LLONG_MAX && errno == ERANGE) || ll > maxval)
+			error = TOOLARGE;
+	}
+	if (errstrp != NULL)
+		*errstrp = ev[error].errstr;
+	errno = ev[error].err;
+	if (error)
+		ll = 0;
+
+	return (ll);
+}
+
+extern char *program_invocation_short_name;
+
+const char *
+getprogname(void)
+{
+	return (program_invocation_short_name);
+}
+
+void
+setprogname(const char *progname)
+{
+	const char *p;
+
+	p = strrchr(progname, '/');
+	program_invocation_short_name = (char *)(p != NULL ? p + 1 : progname);
+}
+
+void
+vwarnc(int code, const char *fmt, va_list ap)
+{
+	fprintf(stderr, "%s: ", getprogname());
+	if (fmt != NULL) {
+		vfprintf(stderr, fmt, ap);
+		fprintf(stderr, ": ");
+	}
+	fprintf(stderr, "%s\n", strerror(code));
+}
+
+void
+warnc(int code, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vwarnc(code, fmt, ap);
+	va_end(ap);
+}
+
+void
+verrc(int eval, int code, const char *fmt, va_list ap)
+{
+	vwarnc(code, fmt, ap);
+	exit(eval);
+}
+
+void
+errc(int eval, int code, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	verrc(eval, code, fmt, ap);
+	va_end(ap);
+}
+
+#ifdef COMPAT_ARC4RANDOM
+/*
+ * not a stream cipher like the real thing, so the arc4random work
+ * loops aren't as expensive as they are on OpenBSD. a xorshift
+ * generator per thread, seeded from the kernel.
+ */
+
+static __thread uint64_t arc4random_state;
+
+uint32_t
+arc4random(void)
+{
+	uint64_t x = arc4random_state;
+
+	while (x == 0) {
+		if (getrandom(&x, sizeof(x), 0) != sizeof(x))
+			x = (uintptr_t)&x ^ (uint64_t)pthread_self();
+	}
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	arc4random_state = x;
+
+	return ((x * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+uint32_t
+arc4random_uniform(uint32_t upper_bound)
+{
+	uint32_t r, min;
+
+	if (upper_bound < 2)
+		return (0);
+
+	/* 2**32 % x == (2**32 - x) % x */
+	min = -upper_bound % upper_bound;
+
+	for (;;) {
+		r = arc4random();
+		if (r >= min)
+			break;
+	}
+
+	return (r % upper_bound);
+}
+#endif /* COMPAT_ARC4RANDOM */
@@ -0,0 +1,86 @@
+/*
+ * the bits of OpenBSD the harness and the mutexes use that other
+ * systems don't have.
+ *
+ * the GNUmakefile includes this at the top of every file it builds,
+ * and puts this directory on the include path so <sys/atomic.h> and
+ * <machine/spinlock.h> come from here.
+ */
+
+#ifndef _COMPAT_H_
+#define _COMPAT_H_
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <sched.h>
+#include <pthread.h>
+
+#ifndef __dead
+#define __dead			__attribute__((__noreturn__))
+#endif
+#ifndef __aligned
+#define __aligned(_x)		__attribute__((__aligned__(_x)))
+#endif
+#ifndef __predict_true
+#define __predict_true(_e)	__builtin_expect(((_e) != 0), 1)
+#define __predict_false(_e)	__builtin_expect(((_e) != 0), 0)
+#endif
+
+#ifndef timespecsub
+#define timespecadd(_a, _b, _r) do {					\
+	(_r)->tv_sec = (_a)->tv_sec + (_b)->tv_sec;			\
+	(_r)->tv_nsec = (_a)->tv_nsec + (_b)->tv_nsec;			\
+	if ((_r)->tv_nsec >= 1000000000L) {				\
+		(_r)->tv_sec++;						\
+		(_r)->tv_nsec -= 1000000000L;				\
+	}								\
+} while (0)
+
+#define timespecsub(_a, _b, _r) do {					\
+	(_r)->tv_sec = (_a)->tv_sec - (_b)->tv_sec;			\
+	(_r)->tv_nsec = (_a)->tv_nsec - (_b)->tv_nsec;			\
+	if ((_r)->tv_nsec < 0) {					\
+		(_r)->tv_sec--;						\
+		(_r)->tv_nsec += 1000000000L;				\
+	}								\
+} while (0)
+
+#define timespeccmp(_a, _b, _cmp)					\
+	(((_a)->tv_sec == (_b)->tv_sec) ?				\
+	    ((_a)->tv_nsec _cmp (_b)->tv_nsec) :			\
+	    ((_a)->tv_sec _cmp (_b)->tv_sec))
+#endif
+
+/* glibc deprecated pthread_yield in favour of this */
+#define pthread_yield()		sched_yield()
+
+long long	 strtonum(const char *, long long, long long, const char **);
+
+const char	*getprogname(void);
+void		 setprogname(const char *);
+
+__dead void	 errc(int, int, const char *, ...);
+__dead void	 verrc(int, int, const char *, va_list);
+void		 warnc(int, const char *, ...);
+void		 vwarnc(int, const char *, va_list);
+
+/* glibc only got arc4random in 2.36 */
+#if defined(__GLIBC__)
+#if !__GLIBC_PREREQ(2, 36)
+#define COMPAT_ARC4RANDOM	1
+#endif
+#elif defined(__linux__)
+#define COMPAT_ARC4RANDOM	1
+#endif
+
+#ifdef COMPAT_ARC4RANDOM
+uint32_t	 arc4random(void);
+uint32_t	 arc4random_uniform(uint32_t);
+#endif
+
+#endif /* _COMPAT_H_ */
@@ -0,0 +1,8 @@
+#ifndef _MACHINE_SPINLOCK_H_
+#define _MACHINE_SPINLOCK_H_
+
+#define _ATOMIC_LOCK_UNLOCKED	(0)
+#define _ATOMIC_LOCK_LOCKED	(1)
+typedef volatile unsigned int _atomic_lock_t;
+
+#endif /* _MACHINE_SPINLOCK_H_ */
@@ -0,0 +1,103 @@
+/*
+ * OpenBSD's atomic operations and memory barriers, built on the
+ * compiler's __atomic builtins.
+ *
+ * like on OpenBSD, the atomic operations themselves don't order
+ * anything. the membar_ functions are what order memory accesses
+ * around them, and membar_enter_after_atomic and
+ * membar_exit_before_atomic only need to do something on cpus where
+ * atomic operations aren't already full barriers.
+ *
+ * the _ptr operations are macros so they also work on pthread_t,
+ * which is a pointer on OpenBSD but an integer on linux.
+ */
+
+#ifndef _SYS_ATOMIC_H_
+#define _SYS_ATOMIC_H_
+
+static inline unsigned int
+_atomic_cas_uint(volatile unsigned int *p, unsigned int e, unsigned int n)
+{
+	__atomic_compare_exchange_n(p, &e, n, 0,
+	    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	return (e);
+}
+#define atomic_cas_uint(_p, _e, _n)	_atomic_cas_uint((_p), (_e), (_n))
+
+static inline unsigned long
+_atomic_cas_ulong(volatile unsigned long *p, unsigned long e,
+    unsigned long n)
+{
+	__atomic_compare_exchange_n(p, &e, n, 0,
+	    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	return (e);
+}
+#define atomic_cas_ulong(_p, _e, _n)	_atomic_cas_ulong((_p), (_e), (_n))
+
+/* the type of what _p points to, without any qualifiers */
+#define __atomic_ptr_t(_p)		__typeof__((void)0, *(_p))
+
+#define atomic_cas_ptr(_p, _e, _n) ({					\
+	__atomic_ptr_t(_p) __e = (__atomic_ptr_t(_p))(_e);		\
+	__atomic_compare_exchange_n((_p), &__e,				\
+	    (__atomic_ptr_t(_p))(_n), 0,				\
+	    __ATOMIC_RELAXED, __ATOMIC_RELAXED);			\
+	__e;								\
+})
+
+static inline unsigned int
+_atomic_swap_uint(volatile unsigned int *p, unsigned int n)
+{
+	return (__atomic_exchange_n(p, n, __ATOMIC_RELAXED));
+}
+#define atomic_swap_uint(_p, _n)	_atomic_swap_uint((_p), (_n))
+
+static inline unsigned long
+_atomic_swap_ulong(volatile unsigned long *p, unsigned long n)
+{
+	return (__atomic_exchange_n(p, n, __ATOMIC_RELAXED));
+}
+#define atomic_swap_ulong(_p, _n)	_atomic_swap_ulong((_p), (_n))
+
+#define atomic_swap_ptr(_p, _n)						\
+	__atomic_exchange_n((_p), (__atomic_ptr_t(_p))(_n),		\
+	    __ATOMIC_RELAXED)
+
+static inline unsigned int
+_atomic_add_int_nv(volatile unsigned int *p, unsigned int v)
+{
+	return (__atomic_add_fetch(p, v, __ATOMIC_RELAXED));
+}
+#define atomic_add_int_nv(_p, _v)	_atomic_add_int_nv((_p), (_v))
+#define atomic_sub_int_nv(_p, _v)	_atomic_add_int_nv((_p), 0 - (_v))
+#define atomic_inc_int_nv(_p)		_atomic_add_int_nv((_p), 1)
+#define atomic_dec_int_nv(_p)		_atomic_add_int_nv((_p), -1)
+
+static inline unsigned long
+_atomic_add_long_nv(volatile unsigned long *p, unsigned long v)
+{
+	return (__atomic_add_fetch(p, v, __ATOMIC_RELAXED));
+}
+#define atomic_add_long_nv(_p, _v)	_atomic_add_long_nv((_p), (_v))
+#define atomic_sub_long_nv(_p, _v)	_atomic_add_long_nv((_p), 0 - (_v))
+#define atomic_inc_long_nv(_p)		_atomic_add_long_nv((_p), 1)
+#define atomic_dec_long_nv(_p)		_atomic_add_long_nv((_p), -1)
+
+#define __membar(_o)			__atomic_thread_fence(_o)
+
+#define membar_enter()			__membar(__ATOMIC_SEQ_CST)
+#define membar_exit()			__membar(__ATOMIC_RELEASE)
+#define membar_producer()		__membar(__ATOMIC_RELEASE)
+#define membar_consumer()		__membar(__ATOMIC_ACQUIRE)
+#define membar_sync()			__membar(__ATOMIC_SEQ_CST)
+
+#if defined(__i386__) || defined(__amd64__) || defined(__x86_64__)
+/* locked instructions are already full barriers */
+#define membar_enter_after_atomic()	__atomic_signal_fence(__ATOMIC_SEQ_CST)
+#define membar_exit_before_atomic()	__atomic_signal_fence(__ATOMIC_SEQ_CST)
+#else
+#define membar_enter_after_atomic()	membar_enter()
+#define membar_exit_before_atomic()	membar_exit()
+#endif
+
+#endif /* _SYS_ATOMIC_H_ */
@@ -0,0 +1,329 @@
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "cpu.h"
+
+#define nitems(_a) (sizeof((_a)) / sizeof((_a)[0]))
+
+int
+cpu_bind(pthread_t pth, int cpu)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	int error;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	error = pthread_setaffinity_np(pth, sizeof(set), &set);
+	if (error != 0) {
+		errno = error;
+		return (-1);
+	}
+
+	return (0);
+#else
+	errno = ENOTSUP;
+	return (-1);
+#endif
+}
+
+#ifdef __linux__
+
+#define CPU_SYSFS	"/sys/devices/system/cpu"
+
+/*
+ * where a cpu sits relative to the others. the key is what the
+ * placement policy sorts the cpus by.
+ */
+
+struct cpu_topo {
+	int		ct_cpu;
+	int		ct_pkg;
+	int		ct_core;	/* only unique within a package */
+	int		ct_l3;		/* the first cpu sharing the l3 */
+	int		ct_smt;		/* which thread on the core */
+	int		ct_crank;	/* which core on the l3 */
+	int		ct_lrank;	/* which l3 in the package */
+	int		ct_key[5];
+};
+
+/*
+ * read the first number in a sysfs file. lists of cpus like
+ * "0-3,8-11" are sorted, so this gets the lowest one.
+ */
+
+static int
+cpu_sysfs(int cpu, const char *file, int def)
+{
+	char path[PATH_MAX];
+	FILE *f;
+	int v;
+
+	snprintf(path, sizeof(path), CPU_SYSFS "/cpu%d/%s", cpu, file);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return (def);
+	if (fscanf(f, "%d", &v) != 1)
+		v = def;
+	fclose(f);
+
+	return (v);
+}
+
+static struct cpu_topo *
+cpu_topology(cpu_set_t *set, size_t *np)
+{
+	struct cpu_topo *cts, *a, *b;
+	size_t n = 0, i, j;
+	int cpu, first;
+
+	if (sched_getaffinity(0, sizeof(*set), set) == -1)
+		err(1, "sched_getaffinity");
+
+	cts = reallocarray(NULL, CPU_COUNT(set), sizeof(*cts));
+	if (cts == NULL)
+		err(1, "cpu topology");
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, set))
+			continue;
+
+		a = &cts[n++];
+		memset(a, 0, sizeof(*a));
+		a->ct_cpu = cpu;
+		a->ct_pkg = cpu_sysfs(cpu, "topology/physical_package_id", 0);
+		a->ct_core = cpu_sysfs(cpu, "topology/core_id", cpu);
+
+		/* without an l3 treat the whole package as sharing one */
+		if (cpu_sysfs(cpu, "cache/index3/level", 0) == 3) {
+			a->ct_l3 = cpu_sysfs(cpu,
+			    "cache/index3/shared_cpu_list", cpu);
+		} else
+			a->ct_l3 = -1;
+	}
+
+	/* number the threads on each core */
+	for (i = 0; i < n; i++) {
+		a = &cts[i];
+		for (j = 0; j < n; j++) {
+			b = &cts[j];
+			if (b->ct_pkg == a->ct_pkg &&
+			    b->ct_core == a->ct_core && b->ct_cpu < a->ct_cpu)
+				a->ct_smt++;
+		}
+	}
+
+	/* number the cores on each l3 by their first thread */
+	for (i = 0; i < n; i++) {
+		a = &cts[i];
+		first = a->ct_cpu;
+		for (j = 0; j < n; j++) {
+			b = &cts[j];
+			if (b->ct_pkg == a->ct_pkg &&
+			    b->ct_core == a->ct_core && b->ct_cpu < first)
+				first = b->ct_cpu;
+		}
+		for (j = 0; j < n; j++) {
+			b = &cts[j];
+			if (b->ct_smt == 0 && b->ct_pkg == a->ct_pkg &&
+			    b->ct_l3 == a->ct_l3 && b->ct_cpu < first)
+				a->ct_crank++;
+		}
+	}
+
+	/* number the l3s in each package by their first core */
+	for (i = 0; i < n; i++) {
+		a = &cts[i];
+		for (j = 0; j < n; j++) {
+			b = &cts[j];
+			if (b->ct_smt == 0 && b->ct_crank == 0 &&
+			    b->ct_pkg == a->ct_pkg && b->ct_l3 < a->ct_l3)
+				a->ct_lrank++;
+		}
+	}
+
+	*np = n;
+	return (cts);
+}
+
+static int
+cpu_topo_cmp(const void *a, const void *b)
+{
+	const struct cpu_topo *cta = a, *ctb = b;
+	size_t i;
+
+	for (i = 0; i < nitems(cta->ct_key); i++) {
+		if (cta->ct_key[i] != ctb->ct_key[i])
+			return (cta->ct_key[i] < ctb->ct_key[i] ? -1 : 1);
+	}
+
+	return (0);
+}
+
+/*
+ * parse a list of cpus, eg, "0,2,4-7".
+ */
+
+static int
+cpu_list(const char *spec, const cpu_set_t *set, int **cpusp, size_t *np)
+{
+	char *list, *item, *dash;
+	const char *errstr;
+	int *cpus = NULL;
+	size_t n = 0;
+	int lo, hi;
+
+	list = strdup(spec);
+	if (list == NULL)
+		err(1, "cpu list");
+
+	while ((item = strsep(&list, ",")) != NULL) {
+		dash = strchr(item, '-');
+		if (dash != NULL)
+			*dash++ = '\0';
+
+		lo = strtonum(item, 0, CPU_SETSIZE - 1, &errstr);
+		if (errstr != NULL) {
+			warnx("cpu %s: %s", item, errstr);
+			return (-1);
+		}
+		hi = lo;
+		if (dash != NULL) {
+			hi = strtonum(dash, lo, CPU_SETSIZE - 1, &errstr);
+			if (errstr != NULL) {
+				warnx("cpu %s: %s", dash, errstr);
+				return (-1);
+			}
+		}
+
+		cpus = reallocarray(cpus, n + (hi - lo) + 1, sizeof(*cpus));
+		if (cpus == NULL)
+			err(1, "cpu list");
+		for (; lo <= hi; lo++) {
+			if (!CPU_ISSET(lo, set)) {
+				warnx("cpu %d is not available", lo);
+				return (-1);
+			}
+			cpus[n++] = lo;
+		}
+	}
+
+	*cpusp = cpus;
+	*np = n;
+	return (0);
+}
+
+int
+cpu_place(const char *spec, int **cpusp, size_t *np)
+{
+	struct cpu_topo *cts, *ct;
+	cpu_set_t set;
+	int *cpus;
+	size_t n, i;
+
+	cts = cpu_topology(&set, &n);
+
+	if (spec[0] >= '0' && spec[0] <= '9') {
+		free(cts);
+		return (cpu_list(spec, &set, cpusp, np));
+	}
+
+	for (i = 0; i < n; i++) {
+		ct = &cts[i];
+
+		if (strcmp(spec, "compact") == 0) {
+			ct->ct_key[0] = ct->ct_smt;
+			ct->ct_key[1] = ct->ct_pkg;
+			ct->ct_key[2] = ct->ct_l3;
+			ct->ct_key[3] = ct->ct_crank;
+		} else if (strcmp(spec, "scatter") == 0) {
+			ct->ct_key[0] = ct->ct_smt;
+			ct->ct_key[1] = ct->ct_crank;
+			ct->ct_key[2] = ct->ct_lrank;
+			ct->ct_key[3] = ct->ct_pkg;
+		} else if (strcmp(spec, "smt") == 0) {
+			ct->ct_key[0] = ct->ct_pkg;
+			ct->ct_key[1] = ct->ct_l3;
+			ct->ct_key[2] = ct->ct_crank;
+			ct->ct_key[3] = ct->ct_smt;
+		} else if (strcmp(spec, "l3") == 0) {
+			ct->ct_key[0] = ct->ct_smt;
+			ct->ct_key[1] = ct->ct_crank;
+			ct->ct_key[2] = ct->ct_pkg;
+			ct->ct_key[3] = ct->ct_lrank;
+		} else {
+			warnx("placement %s: unknown policy", spec);
+			free(cts);
+			return (-1);
+		}
+		ct->ct_key[4] = ct->ct_cpu;
+	}
+
+	qsort(cts, n, sizeof(*cts), cpu_topo_cmp);
+
+	cpus = reallocarray(NULL, n, sizeof(*cpus));
+	if (cpus == NULL)
+		err(1, "placement");
+	for (i = 0; i < n; i++)
+		cpus[i] = cts[i].ct_cpu;
+	free(cts);
+
+	*cpusp = cpus;
+	*np = n;
+	return (0);
+}
+
+int
+cpu_restrict(const char *spec)
+{
+	cpu_set_t set;
+	int *cpus;
+	size_t n, i;
+
+	if (sched_getaffinity(0, sizeof(set), &set) == -1)
+		err(1, "sched_getaffinity");
+	if (cpu_list(spec, &set, &cpus, &n) == -1)
+		return (-1);
+
+	CPU_ZERO(&set);
+	for (i = 0; i < n; i++)
+		CPU_SET(cpus[i], &set);
+	free(cpus);
+
+	/* threads created after this inherit it */
+	if (sched_setaffinity(0, sizeof(set), &set) == -1)
+		err(1, "sched_setaffinity");
+
+	return (CPU_COUNT(&set));
+}
+
+#else /* __linux__ */
+
+int
+cpu_place(const char *spec, int **cpusp, size_t *np)
+{
+	warnx("placement %s: threads can't be bound to cpus here", spec);
+	return (-1);
+}
+
+int
+cpu_restrict(const char *spec)
+{
+	warnx("cpus %s: threads can't be bound to cpus here", spec);
+	return (-1);
+}
+
+#endif /* __linux__ */
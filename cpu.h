@@ -0,0 +1,37 @@
+/*
+ * binding threads to cpus.
+ *
+ * not every system can do this, in which case cpu_bind fails with
+ * errno set to ENOTSUP.
+ *
+ * cpu_place turns a placement policy into the order threads should
+ * be given cpus in. thread i goes on cpus[i % n]. the policies are:
+ *
+ *  - compact: one thread per core, filling an l3 and then a package
+ *    before moving on to the next. smt siblings are only used once
+ *    every core has a thread.
+ *  - scatter: one thread per core, spread across the packages, and
+ *    then across the l3s in each package.
+ *  - smt: both smt siblings of a core before moving to the next one,
+ *    otherwise like compact.
+ *  - l3: one thread on each l3, in package order, before a second
+ *    one goes on any of them.
+ *  - a list of cpus, eg, "0,2,4-7".
+ *
+ * only the cpus the process is allowed to run on are used.
+ *
+ * cpu_restrict limits the calling thread, and the threads it creates
+ * after that, to a list of cpus, and returns how many there are.
+ */
+
+#ifndef _CPU_H_
+#define _CPU_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+int	cpu_bind(pthread_t, int);
+int	cpu_place(const char *, int **, size_t *);
+int	cpu_restrict(const char *);
+
+#endif /* _CPU_H_ */
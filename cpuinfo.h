@@ -0,0 +1,75 @@
+/*
+ * an emulated struct cpu_info.
+ *
+ * the kernel can find the cpu it is running on with curcpu(), and
+ * the locks use that as the owner of a mutex and as somewhere to
+ * keep the nodes they queue on while they wait. in userland the
+ * mutex implementations usually fake this with pthread_self() and
+ * nodes on the stack. the harness gives every thread running the
+ * work loops its own struct cpu_info instead, allocated by the
+ * thread after it is bound to its cpu, and curcpu() finds it via
+ * thread local storage.
+ *
+ * the nodes are kept in a small stack of cacheline sized slots, one
+ * for each level a cpu can be nested inside mtx_enter, eg, by taking
+ * a mutex in an interrupt handler while it was waiting for another
+ * one. cpu_node_get and cpu_node_put have to be called in order.
+ */
+
+#ifndef _CPUINFO_H_
+#define _CPUINFO_H_
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <assert.h>
+
+#include "atomic.h"
+
+#define CPU_NNODES		4
+#define CPU_NODESIZE		(2 * CACHELINESIZE)
+
+struct cpu_node {
+	u_char			 cn_data[CPU_NODESIZE];
+} __aligned(CACHELINESIZE);
+
+struct cpu_info {
+	unsigned int		 ci_cpuid;	/* small index */
+	unsigned int		 ci_nnodes;	/* nodes in use */
+	uint64_t		 ci_spinouts;	/* gave up spinning */
+	struct cpu_node		 ci_nodes[CPU_NNODES];
+} __aligned(CACHELINESIZE);
+
+extern __thread struct cpu_info *cpu_info_self;
+
+#define curcpu()		(cpu_info_self)
+#define CPU_SPINOUT(_ci)	((_ci)->ci_spinouts++)
+
+static inline void
+cpu_info_attach(struct cpu_info *ci, unsigned int cpuid)
+{
+	ci->ci_cpuid = cpuid;
+	ci->ci_nnodes = 0;
+	ci->ci_spinouts = 0;
+	cpu_info_self = ci;
+}
+
+static inline void *
+cpu_node_get(void)
+{
+	struct cpu_info *ci = curcpu();
+
+	assert(ci->ci_nnodes < CPU_NNODES);
+	return (&ci->ci_nodes[ci->ci_nnodes++]);
+}
+
+static inline void
+cpu_node_put(void *n)
+{
+	struct cpu_info *ci = curcpu();
+
+	ci->ci_nnodes--;
+	assert(n == &ci->ci_nodes[ci->ci_nnodes]);
+}
+
+#endif /* _CPUINFO_H_ */
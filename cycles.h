@@ -0,0 +1,54 @@
+
+/*
+ * cheap timestamps for measuring individual lock operations.
+ *
+ * this reads the cpus cycle counter directly where it's possible to,
+ * and falls back to the monotonic clock (ie, nanoseconds) otherwise.
+ * the harness calibrates the counter against the monotonic clock at
+ * startup so results can be reported in nanoseconds.
+ *
+ * in a simulation the counter is the virtual cpus clock.
+ */
+
+#ifndef _CYCLES_H_
+#define _CYCLES_H_
+
+/*
+ * the tsc ticks at the cpus nominal clock rate, but the counter on
+ * arm64 ticks at a fixed rate that has nothing to do with the cores.
+ */
+#if defined(__i386__) || defined(__amd64__)
+#define CYCLES_CORE		1
+#endif
+
+#ifdef MTX_SIM
+#include "sim.h"
+#endif
+
+static inline uint64_t
+cycles(void)
+{
+#if defined(MTX_SIM)
+	return (sim_now());
+#elif defined(__i386__) || defined(__amd64__)
+	uint32_t lo, hi;
+
+	asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+
+	return ((uint64_t)hi << 32 | lo);
+#elif defined(__aarch64__)
+	uint64_t v;
+
+	asm volatile("isb; mrs %0, cntvct_el0" : "=r" (v));
+
+	return (v);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#endif
+}
+
+#endif /* _CYCLES_H_ */
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <err.h>
+
+#include <pthread.h>
+
+#include "delay.h"
+#include "spin.h"
+
+#define nitems(_a) (sizeof((_a)) / sizeof((_a)[0]))
+
+struct delay delay_conf;
+
+static const char *delay_names[] = DELAY_NAMES;
+
+/*
+ * parse kind[=nsec][,p=probability][,intr], eg, "stall=20000,p=0.01".
+ */
+
+int
+delay_config(const char *spec)
+{
+	char *list, *item, *val, *end;
+	const char *errstr;
+	size_t i;
+
+	list = strdup(spec);
+	if (list == NULL)
+		err(1, "delay config");
+
+	delay_conf.d_p = 0.01;
+
+	item = strsep(&list, ",");
+	val = strchr(item, '=');
+	if (val != NULL)
+		*val++ = '\0';
+
+	for (i = 0; i < nitems(delay_names); i++) {
+		if (strcmp(delay_names[i], item) == 0)
+			break;
+	}
+	if (i == nitems(delay_names)) {
+		warnx("delay %s: unknown kind", item);
+		return (-1);
+	}
+	delay_conf.d_kind = i;
+
+	if (delay_conf.d_kind == DELAY_YIELD) {
+		if (val != NULL) {
+			warnx("delay yield: doesn't take a time");
+			return (-1);
+		}
+	} else {
+		if (val == NULL) {
+			warnx("delay %s: expected %s=nsec", item, item);
+			return (-1);
+		}
+		delay_conf.d_nsec = strtonum(val, 1, 10000000000LL, &errstr);
+		if (errstr != NULL) {
+			warnx("delay %s %s: %s", item, val, errstr);
+			return (-1);
+		}
+	}
+
+	while ((item = strsep(&list, ",")) != NULL) {
+		if (strcmp(item, "intr") == 0) {
+			delay_conf.d_intr = 1;
+			continue;
+		}
+
+		if (strncmp(item, "p=", 2) != 0) {
+			warnx("delay %s: expected p=probability or intr", item);
+			return (-1);
+		}
+		delay_conf.d_p = strtod(item + 2, &end);
+		if (end == item + 2 || *end != '\0' ||
+		    delay_conf.d_p <= 0.0 || delay_conf.d_p > 1.0) {
+			warnx("delay %s: probability is invalid", item);
+			return (-1);
+		}
+	}
+
+	delay_conf.d_thresh = delay_conf.d_p * 4294967296.0;
+
+	return (0);
+}
+
+void
+delay_run(void)
+{
+	struct timespec ts;
+
+	switch (delay_conf.d_kind) {
+	case DELAY_YIELD:
+		pthread_yield();
+		break;
+	case DELAY_SLEEP:
+		ts.tv_sec = delay_conf.d_nsec / 1000000000ULL;
+		ts.tv_nsec = delay_conf.d_nsec % 1000000000ULL;
+		nanosleep(&ts, NULL);
+		break;
+	case DELAY_STALL:
+		spin_wait(spin_count(delay_conf.d_nsec));
+		break;
+	}
+}
+
+void
+delay_print(void)
+{
+	printf("\"delay\":{");
+	printf("\"kind\":\"%s\",", delay_names[delay_conf.d_kind]);
+	if (delay_conf.d_kind != DELAY_YIELD)
+		printf("\"nsec\":%llu,", delay_conf.d_nsec);
+	printf("\"p\":%g,", delay_conf.d_p);
+	printf("\"in\":\"%s\"", delay_conf.d_intr ? "intr" : "hold");
+	printf("}");
+}
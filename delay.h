@@ -0,0 +1,50 @@
+/*
+ * injected delays.
+ *
+ * -D makes threads stall every so often while they hold the lock,
+ * like a lock holder that gets preempted or takes a long interrupt.
+ * with -I the delay can go in the interrupt handler instead, which
+ * mostly lands on threads waiting in mtx_enter because the holder
+ * has the signal blocked. a stalled waiter at the head of a queue
+ * holds up everyone behind it.
+ *
+ * each thread decides whether to stall with its own random number
+ * generator, so deciding doesn't add contention of its own.
+ */
+
+#ifndef _DELAY_H_
+#define _DELAY_H_
+
+#include <stdint.h>
+
+#include "rng.h"
+
+enum delay_kind {
+	DELAY_YIELD,		/* give the cpu away */
+	DELAY_SLEEP,		/* nanosleep */
+	DELAY_STALL,		/* spin without giving the cpu away */
+};
+
+#define DELAY_NAMES { "yield", "sleep", "stall" }
+
+struct delay {
+	enum delay_kind		 d_kind;
+	uint64_t		 d_nsec;
+	double			 d_p;		/* probability */
+	uint64_t		 d_thresh;	/* d_p scaled to 2^32 */
+	int			 d_intr;	/* in the -I handler */
+};
+
+extern struct delay delay_conf;
+
+int	delay_config(const char *);
+void	delay_run(void);
+void	delay_print(void);
+
+static inline int
+delay_hit(uint64_t *rng)
+{
+	return ((rng_next(rng) >> 32) < delay_conf.d_thresh);
+}
+
+#endif /* _DELAY_H_ */
@@ -0,0 +1,126 @@
+/*
+ * the state shared between the harness in main.c and the work loops
+ * in work.c.
+ */
+
+#ifndef _HARNESS_H_
+#define _HARNESS_H_
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "hist.h"
+#include "perf.h"
+#include "trace.h"
+#include "lockstat.h"
+#include "lock.h"
+#include "cpuinfo.h"
+
+/*
+ * a sense reversing barrier. each thread flips its own idea of the
+ * sense every time it waits, and the last thread to arrive flips
+ * the barriers sense to let everyone go.
+ */
+
+struct barrier {
+	volatile unsigned int	b_count;
+	volatile unsigned int	b_sense;
+	unsigned int		b_n;
+};
+
+/*
+ * the number the work loops increment sits right after the mutex so
+ * they fight over the same cacheline.
+ */
+
+struct state {
+	u_char			mtx[MTX_MAXSIZE] __aligned(16);
+	volatile uint64_t	v;
+	uint64_t		released;	/* -h: when mtx was released */
+	unsigned int		releaser;	/* -h: who released mtx */
+	uint64_t		loops;
+	uint64_t		nthreads;
+	uint64_t		ops;
+	const struct lock	*lk;
+	const struct work	*w;
+	u_char			_pad[128];
+	volatile uint64_t	pv;
+	u_char			_pad1[128];
+	volatile int		stop;
+	u_char			_pad2[128];
+
+	/* -I: the mutex the interrupt handlers take */
+	u_char			imtx[MTX_MAXSIZE] __aligned(16);
+	uint64_t		intrs;
+	u_char			_pad3[128];
+
+	/* -C: how many workers are in a burst */
+	volatile unsigned int	active;
+	u_char			_pad4[128];
+
+	struct tstate		**tsp;		/* allocated by each worker */
+	uint64_t		warmup;		/* loops before timing */
+	struct barrier		start;		/* workers and main */
+	struct barrier		warm;		/* workers after warmup */
+
+	/*
+	 * the window where every thread was running the work loop
+	 * opens when the last thread starts and closes when the first
+	 * one finishes.
+	 */
+	volatile unsigned int	started;
+	volatile unsigned int	finished;
+	uint64_t		wopen;		/* nsec */
+	uint64_t		wopen_ops;
+	uint64_t		wclose;		/* nsec */
+	uint64_t		wclose_ops;
+} __aligned(128);
+
+struct tstate {
+	unsigned int		 id;
+	struct state		*state;
+
+	uint64_t		 loops;
+	uint64_t		 ops;
+	uint64_t		 acquisitions;
+
+	int			 flags;
+#define TS_TIMING			(1 << 0)
+#define TS_HANDOFF			(1 << 1)
+#define TS_PERF				(1 << 2)
+#define TS_TRACE			(1 << 3)
+#define TS_INTR				(1 << 4)
+#define TS_DELAY			(1 << 5)
+/* the flags lock_enter and lock_leave have to do work for */
+#define TS_INSTRUMENT			(TS_TIMING | TS_HANDOFF | TS_TRACE | \
+					    TS_INTR | TS_DELAY)
+	uint64_t		 began;		/* nsec */
+	uint64_t		 ended;		/* nsec */
+	struct timeval		 utime;		/* cpu used while timed */
+	struct timeval		 stime;
+	uint64_t		 nvcsw;
+	uint64_t		 nivcsw;	/* preempted while timed */
+	uint64_t		 intrs;		/* -I handlers run */
+	uint64_t		 intr_cycles;	/* spent in them */
+	unsigned long		 ipl;		/* from intr_disable */
+	uint64_t		 rng;		/* for -D and -C */
+	uint64_t		 irng;		/* for -D intr */
+	uint64_t		 delays;	/* -D delays injected */
+	uint64_t		 joins;		/* -C bursts */
+
+	uint64_t		 start;
+	uint64_t		 held;
+	uint64_t		 handoff;
+	struct hist		 wait;
+	struct hist		 hold;
+	struct hist		 handoffs;
+	struct perf		 perf;
+	struct trace_ring	 trace;
+	struct lockstat		 lockstat;
+	struct cpu_info		 ci;
+} __aligned(128);
+
+#endif /* _HARNESS_H_ */
@@ -0,0 +1,75 @@
+#include <stdint.h>
+
+#include "hist.h"
+
+void
+hist_merge(struct hist *dst, const struct hist *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+		dst->h_buckets[i] += src->h_buckets[i];
+
+	dst->h_count += src->h_count;
+	dst->h_sum += src->h_sum;
+	if (src->h_max > dst->h_max)
+		dst->h_max = src->h_max;
+}
+
+/*
+ * the smallest value that would be counted in a bucket.
+ */
+static uint64_t
+hist_bucket_min(unsigned int b)
+{
+	unsigned int g = b >> HIST_SUB_BITS;
+
+	if (g == 0)
+		return (b);
+
+	return ((uint64_t)(HIST_SUB | (b & (HIST_SUB - 1))) << (g - 1));
+}
+
+static uint64_t
+hist_bucket_width(unsigned int b)
+{
+	unsigned int g = b >> HIST_SUB_BITS;
+
+	if (g == 0)
+		return (1);
+
+	return (1ULL << (g - 1));
+}
+
+/*
+ * return the value at quantile q (0 to 1). this is the middle of the
+ * bucket holding that value, which is accurate to within the bucket
+ * resolution, but is never reported as larger than the biggest value
+ * that was actually added.
+ */
+uint64_t
+hist_quantile(const struct hist *h, double q)
+{
+	uint64_t rank, seen = 0;
+	uint64_t v;
+	unsigned int i;
+
+	if (h->h_count == 0)
+		return (0);
+
+	rank = q * h->h_count;
+	if (rank >= h->h_count)
+		rank = h->h_count - 1;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->h_buckets[i];
+		if (seen > rank)
+			break;
+	}
+
+	v = hist_bucket_min(i) + hist_bucket_width(i) / 2;
+	if (v > h->h_max)
+		v = h->h_max;
+
+	return (v);
+}
@@ -0,0 +1,48 @@
+
+/*
+ * log-linear histograms, in the style of HdrHistogram.
+ *
+ * values are split into power of two ranges, and each range is split
+ * into HIST_SUB linear buckets. this gives a constant relative error
+ * of 1/HIST_SUB over the whole 64bit range with a fixed amount of
+ * memory, and makes adding a value cheap enough to do it on every
+ * lock operation.
+ */
+
+#define HIST_SUB_BITS		5
+#define HIST_SUB		(1U << HIST_SUB_BITS)
+#define HIST_BUCKETS		((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct hist {
+	uint64_t		h_count;
+	uint64_t		h_sum;
+	uint64_t		h_max;
+	uint64_t		h_buckets[HIST_BUCKETS];
+};
+
+static inline unsigned int
+hist_bucket(uint64_t v)
+{
+	unsigned int e;
+
+	if (v < HIST_SUB)
+		return (v);
+
+	e = 63 - __builtin_clzll(v);
+
+	return ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS |
+	    ((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1)));
+}
+
+static inline void
+hist_add(struct hist *h, uint64_t v)
+{
+	h->h_buckets[hist_bucket(v)]++;
+	h->h_count++;
+	h->h_sum += v;
+	if (v > h->h_max)
+		h->h_max = v;
+}
+
+void		hist_merge(struct hist *, const struct hist *);
+uint64_t	hist_quantile(const struct hist *, double);
@@ -0,0 +1,55 @@
+#include <signal.h>
+#include <string.h>
+#include <err.h>
+
+#include <pthread.h>
+
+#include "intr.h"
+
+int intr_masking;
+
+unsigned long
+intr_mask(void)
+{
+	sigset_t set, oset;
+	int error;
+
+	sigemptyset(&set);
+	sigaddset(&set, INTR_SIGNAL);
+
+	error = pthread_sigmask(SIG_BLOCK, &set, &oset);
+	if (error != 0)
+		errc(1, error, "intr mask");
+
+	return (sigismember(&oset, INTR_SIGNAL));
+}
+
+void
+intr_unmask(void)
+{
+	sigset_t set;
+	int error;
+
+	sigemptyset(&set);
+	sigaddset(&set, INTR_SIGNAL);
+
+	error = pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+	if (error != 0)
+		errc(1, error, "intr unmask");
+}
+
+void
+intr_establish(void (*handler)(int))
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+
+	if (sigaction(INTR_SIGNAL, &sa, NULL) == -1)
+		err(1, "sigaction");
+
+	intr_masking = 1;
+}
@@ -0,0 +1,45 @@
+/*
+ * emulated interrupts.
+ *
+ * with -I the harness periodically sends a signal to each thread
+ * running the work loops, and the signal handler takes a mutex like
+ * an interrupt handler would. intr_disable and intr_restore block
+ * and unblock that signal, so the mutex implementations can keep
+ * interrupts out of the places the kernel would, eg, while holding
+ * a parking lot bucket lock. without -I they do nothing.
+ *
+ * like the kernel version, intr_disable returns what intr_restore
+ * needs to put things back the way they were, so they nest.
+ */
+
+#ifndef _INTR_H_
+#define _INTR_H_
+
+#include <signal.h>
+
+#define INTR_SIGNAL		SIGUSR1
+
+extern int intr_masking;
+
+unsigned long	intr_mask(void);
+void		intr_unmask(void);
+void		intr_establish(void (*)(int));
+
+static inline unsigned long
+intr_disable(void)
+{
+	if (!intr_masking)
+		return (0);
+
+	return (intr_mask());
+}
+
+static inline void
+intr_restore(unsigned long m)
+{
+	/* m is set if the signal was already blocked */
+	if (intr_masking && m == 0)
+		intr_unmask();
+}
+
+#endif /* _INTR_H_ */
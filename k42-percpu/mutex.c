@@ -0,0 +1 @@
+../k42/mutex.c
\ No newline at end of file
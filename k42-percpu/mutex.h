@@ -0,0 +1 @@
+../k42/mutex.h
\ No newline at end of file
@@ -7,6 +7,14 @@
 
 #include <mutex.h>
 #include "../atomic.h"
+#include "../lockstat.h"
+
+#ifdef MTX_PERCPU
+#include "../cpuinfo.h"
+
+_Static_assert(sizeof(struct mutex) <= CPU_NODESIZE,
+    "struct mutex doesn't fit in a cpu_info node");
+#endif
 
 void
 mtx_init(struct mutex *mtx)
@@ -38,7 +46,11 @@ mtx_enter_try(struct mutex *mtx)
 void
 mtx_enter(struct mutex *mtx)
 {
-	struct mutex self;
+#ifdef MTX_PERCPU
+	struct mutex *self = NULL;
+#else
+	struct mutex _self, *self = &_self;
+#endif
 	struct mutex *v, *ov;
 
 	v = READ_ONCE(mtx->mtx_tail);
@@ -49,38 +61,56 @@ mtx_enter(struct mutex *mtx)
 			if (v == NULL) {
 				/* we have the lock */
 				membar_enter_after_atomic();
+				LOCKSTAT_INC(LS_FAST);
+#ifdef MTX_PERCPU
+				if (self != NULL)
+					cpu_node_put(self);
+#endif
 				return;
 			}
 		}
 
 		/* lock appears to be held */
-		self.mtx_next = NULL;
-		self.mtx_tail = &self;
-
-		ov = mtx_cas(&mtx->mtx_tail, v, &self);
+#ifdef MTX_PERCPU
+		if (self == NULL)
+			self = cpu_node_get();
+#endif
+		self->mtx_next = NULL;
+		self->mtx_tail = self;
+
+		ov = mtx_cas(&mtx->mtx_tail, v, self);
 		if (ov != v) {
 			v = ov;
 			continue;
 		}
 
 		/* we are in line */
-		WRITE_ONCE(v->mtx_next, &self);
+		LOCKSTAT_INC(LS_PARK);
+#ifdef MTX_PERCPU
+		CPU_SPINOUT(curcpu());
+#endif
+		WRITE_ONCE(v->mtx_next, self);
 		/* wait for the lock */
-		while (READ_ONCE(self.mtx_tail))
+		while (READ_ONCE(self->mtx_tail)) {
 			CPU_BUSY_CYCLE();
+			LOCKSTAT_INC(LS_PARK_SPINS);
+		}
 
 		/* we now have the lock */
-		v = READ_ONCE(self.mtx_next);
+		v = READ_ONCE(self->mtx_next);
 		if (v == NULL) {
 			WRITE_ONCE(mtx->mtx_next, NULL);
-			if (mtx_cas(&mtx->mtx_tail, &self, mtx) != &self) {
+			if (mtx_cas(&mtx->mtx_tail, self, mtx) != self) {
 				/* somebody got into the timing window */
-				while ((v = READ_ONCE(self.mtx_next)) == NULL)
+				while ((v = READ_ONCE(self->mtx_next)) == NULL)
 					CPU_BUSY_CYCLE();
 				WRITE_ONCE(mtx->mtx_next, v);
 			}
 		} else
 			WRITE_ONCE(mtx->mtx_next, v);
+#ifdef MTX_PERCPU
+		cpu_node_put(self);
+#endif
 		return;
 	}
 }
@@ -98,9 +128,11 @@ mtx_leave(struct mutex *mtx)
 		if (mtx_cas(&mtx->mtx_tail, mtx, NULL) == mtx)
 			return;
 
+		LOCKSTAT_INC(LS_LEAVE_SLOW);
 		while ((v = READ_ONCE(mtx->mtx_next)) == NULL)
 			CPU_BUSY_CYCLE();
 	}
 
-	v->mtx_tail = NULL;
+	LOCKSTAT_INC(LS_HANDOFF);
+	WRITE_ONCE(v->mtx_tail, NULL);
 }
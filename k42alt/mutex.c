@@ -7,6 +7,7 @@
 
 #include <mutex.h>
 #include "../atomic.h"
+#include "../lockstat.h"
 
 void
 mtx_init(struct mutex *mtx)
@@ -50,13 +51,17 @@ mtx_enter(struct mutex *mtx)
 	v = mtx_swap(&mtx->mtx_tail, &self);
 	if (v != NULL) {
 		/* queue was non-empty */
+		LOCKSTAT_INC(LS_PARK);
 		self.mtx_tail = &self; /* set locked */
 		WRITE_ONCE(v->mtx_next, &self);
 
 		/* wait for the lock */
-		while (READ_ONCE(self.mtx_tail) != NULL)
+		while (READ_ONCE(self.mtx_tail) != NULL) {
 			CPU_BUSY_CYCLE();
-	}
+			LOCKSTAT_INC(LS_PARK_SPINS);
+		}
+	} else
+		LOCKSTAT_INC(LS_FAST);
 
 	v = READ_ONCE(self.mtx_next); /* read successor */
 	if (v == NULL) {
@@ -82,9 +87,11 @@ mtx_leave(struct mutex *mtx)
 		if (mtx_cas(&mtx->mtx_tail, mtx, NULL) == mtx)
 			return;
 
+		LOCKSTAT_INC(LS_LEAVE_SLOW);
 		while ((v = READ_ONCE(mtx->mtx_next)) == NULL)
 			CPU_BUSY_CYCLE();
 	}
 
+	LOCKSTAT_INC(LS_HANDOFF);
 	v->mtx_tail = NULL;
 }
@@ -0,0 +1,49 @@
+/*
+ * the table of mutex implementations in a test binary.
+ *
+ * work.c is compiled against a mutex implementation, and registers
+ * it with the harness along with copies of the work loops that call
+ * its mtx_enter and mtx_leave directly. the test in each subdir has
+ * one of these, and the one in locks/ has every implementation, with
+ * the mtx_ functions in each renamed by mutex_api.h so they don't
+ * collide.
+ *
+ * the harness doesn't know what a struct mutex looks like, so it
+ * keeps space for the biggest one and leaves the rest to work.c.
+ */
+
+#ifndef _LOCK_H_
+#define _LOCK_H_
+
+#include <stdint.h>
+
+#define MTX_MAXSIZE		32
+#define LOCK_MAX		32
+
+struct state;
+struct tstate;
+
+struct work {
+	const char		*name;
+	void			(*func)(struct tstate *);
+	void			(*check)(struct state *);
+};
+
+struct lock {
+	const char		*name;
+	void			(*init)(void *);
+	const struct work	*works;
+	unsigned int		 nworks;
+
+	/* -M lock, see pingpong.c */
+	void			(*pingpong)(void *, volatile uint64_t *,
+				    unsigned int, uint64_t);
+
+	/* -I, run from the signal handler */
+	void			(*intr)(struct tstate *);
+};
+
+void			 lock_register(const struct lock *);
+const struct lock	*lock_lookup(const char *);
+
+#endif /* _LOCK_H_ */
@@ -0,0 +1,56 @@
+
+/*
+ * lock statistics.
+ *
+ * when the tests are built with LOCKSTAT defined, the mutex
+ * implementations count how often they take each of their paths.
+ * the counters are per thread so counting doesn't add contention of
+ * its own, and the harness adds them up after the threads finish.
+ * without LOCKSTAT the counting compiles away to nothing.
+ *
+ * not every implementation has every path. the queue based locks
+ * (ticket, k42, spinlist) count waiting in their queue as parking.
+ */
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+#include <stdint.h>
+
+enum lockstat_counter {
+	LS_FAST,		/* got the lock on the first try */
+	LS_SPIN,		/* got the lock by spinning on it */
+	LS_SPINS,		/* spins while spinning on the lock */
+	LS_PARK,		/* waited for the lock in a queue */
+	LS_PARK_SPINS,		/* spins while waiting in a queue */
+	LS_STEAL,		/* woken up, but the lock was stolen */
+	LS_BUCKET,		/* took a parking lot or waitlist lock */
+	LS_BUCKET_SPINS,	/* spins while taking those locks */
+	LS_LEAVE_SLOW,		/* mtx_leave had to look for waiters */
+	LS_HANDOFF,		/* mtx_leave woke or handed over to a waiter */
+
+	LS_NCOUNTERS
+};
+
+#define LOCKSTAT_NAMES {						\
+	"fast", "spin", "spins", "park", "park_spins", "steal",		\
+	"bucket", "bucket_spins", "leave_slow", "handoff",		\
+}
+
+struct lockstat {
+	uint64_t		 ls_counters[LS_NCOUNTERS];
+};
+
+#ifdef LOCKSTAT
+extern __thread struct lockstat *lockstat_thread;
+
+#define LOCKSTAT_INC(_c) do {						\
+	struct lockstat *__ls = lockstat_thread;			\
+	if (__ls != NULL)						\
+		__ls->ls_counters[(_c)]++;				\
+} while (0)
+#else
+#define LOCKSTAT_INC(_c) do { } while (0)
+#endif
+
+#endif /* _LOCKSTAT_H_ */
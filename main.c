@@ -5,15 +5,28 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <time.h>
 #include <err.h>
+#include <errno.h>
 
 #include <pthread.h>
 
-#include <mutex.h>
-
 #include "atomic.h"
+#include "cpu.h"
+#include "cycles.h"
+#include "harness.h"
+#include "delay.h"
+#include "noise.h"
+#include "churn.h"
+#include "intr.h"
+#include "pingpong.h"
+#include "stats.h"
+#include "spin.h"
+#ifdef MTX_SIM
+#include "sim.h"
+#endif
 
 #define XSTR(S) #S
 #define STR(S) XSTR(S)
@@ -21,278 +34,1539 @@
 #define nitems(_a) (sizeof((_a)) / sizeof((_a)[0]))
 
 int ncpus;
+#ifdef MTX_SIM
+#define LOOPS 1000LLU
+#else
 #define LOOPS 1000000LLU
+#endif
 int x = 8;
 //000000
 
-struct work;
+#define TRACE_BITS	20	/* events per thread in a trace ring */
+#define MAXTHREADS	1024	/* -n can oversubscribe the cpus */
 
-struct state {
-	volatile int		bar;
-	struct mutex		mtx;
-	struct mutex		mtx1;
-	uint64_t		loops;
-	uint64_t		nthreads;
-	const struct work	*w;
-	volatile uint64_t	v;
-	u_char			_pad[128];
-	volatile uint64_t	pv;
-};
+/* the virtual cpus all run on one real thread */
+#if defined(RUSAGE_THREAD) && !defined(MTX_SIM)
+#define THREAD_RUSAGE
+#endif
 
-struct tstate {
-	unsigned int		 id;
-	pthread_t		 pth;
-	struct state		*state;
-} __aligned(128);
+#ifdef LOCKSTAT
+__thread struct lockstat *lockstat_thread;
+#endif
+__thread struct cpu_info *cpu_info_self;
 
 const char *testname;
 
+/*
+ * the mutex implementations in this binary, see lock.h.
+ */
+
+static const struct lock *locks[LOCK_MAX];
+static unsigned int nlocks;
+
+void
+lock_register(const struct lock *lk)
+{
+	if (nlocks == nitems(locks))
+		errx(1, "too many locks");
+	locks[nlocks++] = lk;
+}
+
+const struct lock *
+lock_lookup(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < nlocks; i++) {
+		if (strcmp(locks[i]->name, name) == 0)
+			return (locks[i]);
+	}
+
+	errx(1, "%s lock not found", name);
+}
+
 __dead static void
 usage(void)
 {
-	fprintf(stderr, "usage: %s [-n nthreads]\n", testname);
+	fprintf(stderr, "usage: %s [-HhP] [-C churn] [-c cpus] [-D delay] "
+	    "[-e events] [-I usec] [-i msec] [-L locks] "
+	    "[-l loops | -t seconds] [-N noise] [-n nthreads] [-p placement] "
+	    "[-R warmups] [-r reps] [-S model] [-s budgets] [-T tracefile] "
+	    "[-W loops] [-w work] [-x x]\n"
+	    "       %s -M lock | line [-L locks] [-l rounds]\n",
+	    testname, testname);
 
 	exit(0);
 }
 
 static void
-work_inc(struct tstate *ts)
+barrier_init(struct barrier *b, unsigned int n)
 {
-	struct state *s = ts->state;
-	uint64_t i;
-	uint64_t loops = s->loops;
+	b->b_count = n;
+	b->b_sense = 0;
+	b->b_n = n;
+}
+
+static void
+barrier_wait(struct barrier *b, unsigned int *sense)
+{
+	unsigned int spins = 0;
+
+	*sense = !*sense;
 
-	for (i = 0; i < loops; i++) {
-		mtx_enter(&s->mtx);
-		s->v++;
-		mtx_leave(&s->mtx);
+	if (atomic_dec_int_nv(&b->b_count) == 0) {
+		b->b_count = b->b_n;
+		membar_producer();
+		WRITE_ONCE(b->b_sense, *sense);
+		return;
 	}
+
+	while (READ_ONCE(b->b_sense) != *sense) {
+		/* give the cpu away if there are more threads than cpus */
+		if (++spins % 1024 == 0)
+			pthread_yield();
+		else
+			CPU_BUSY_CYCLE();
+	}
+	membar_consumer();
+}
+
+static uint64_t cycles2ns(uint64_t);
+
+static uint64_t
+timestamp(void)
+{
+#ifdef MTX_SIM
+	return (cycles2ns(cycles()));
+#else
+	struct timespec now;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now) == -1)
+		err(1, "timestamp");
+
+	return (now.tv_sec * 1000000000ULL + now.tv_nsec);
+#endif
+}
+
+static uint64_t
+state_ops(const struct state *s)
+{
+	uint64_t ops = 0;
+	unsigned int i;
+
+	for (i = 0; i < s->nthreads; i++)
+		ops += READ_ONCE(s->tsp[i]->ops);
+
+	return (ops);
 }
 
+/*
+ * throw away everything a thread counted during the warmup.
+ */
+
 static void
-check_inc(struct state *s)
+tstate_reset(struct tstate *ts)
 {
-	if (s->v != s->loops * s->nthreads)
-		errx(1, "unexpected value %llu after workers finished", s->v);
+	ts->ops = 0;
+	ts->acquisitions = 0;
+	ts->handoff = UINT64_MAX;
+	memset(&ts->wait, 0, sizeof(ts->wait));
+	memset(&ts->hold, 0, sizeof(ts->hold));
+	memset(&ts->handoffs, 0, sizeof(ts->handoffs));
+	memset(&ts->lockstat, 0, sizeof(ts->lockstat));
+	ts->ci.ci_spinouts = 0;
+	ts->delays = 0;
+	ts->joins = 0;
+	timerclear(&ts->utime);
+	timerclear(&ts->stime);
+	ts->nvcsw = ts->nivcsw = 0;
+	ts->trace.tr_next = 0;
 }
 
+/*
+ * what main knows about a worker before it starts. the worker binds
+ * itself to its cpu and then allocates its own tstate, so the memory
+ * is first touched on the node it will be used from.
+ */
+
+struct thread {
+	struct state		*state;
+	unsigned int		 id;
+	int			 cpu;		/* -1 if not bound */
+	int			 flags;		/* TS_* */
+	pthread_t		 pth;
+};
+
+static struct tstate *
+tstate_alloc(const struct thread *t)
+{
+	struct tstate *ts;
+
+	/* calloc doesn't know the threads want their own cachelines */
+	ts = aligned_alloc(_Alignof(struct tstate), sizeof(*ts));
+	if (ts == NULL)
+		err(1, "thread %u alloc", t->id);
+	memset(ts, 0, sizeof(*ts));
+
+	ts->id = t->id;
+	ts->state = t->state;
+	ts->flags = t->flags;
+	ts->handoff = UINT64_MAX;
+	ts->loops = t->state->loops;
+	ts->rng = RNG_SEED(t->id);
+	/* the -I handler can't share rng with the thread it interrupts */
+	ts->irng = RNG_SEED(t->id + MAXTHREADS);
+
+	if (ts->flags & TS_TRACE) {
+		if (trace_alloc(&ts->trace, TRACE_BITS) == -1)
+			err(1, "trace ring %u", t->id);
+		/* fault the ring in before the run starts */
+		memset(ts->trace.tr_events, 0,
+		    (ts->trace.tr_mask + 1) * sizeof(*ts->trace.tr_events));
+	}
+
+	return (ts);
+}
+
+/*
+ * -I: the signal handler is the interrupt handler for the cpu the
+ * worker is running on.
+ */
+
+static __thread struct tstate *intr_tstate;
+
 static void
-work_inc_padded(struct tstate *ts)
+intr_handler(int sig)
 {
-	struct state *s = ts->state;
-	uint64_t i;
-	uint64_t loops = s->loops;
+	struct tstate *ts = intr_tstate;
+	int serrno = errno;
+	uint64_t c;
 
-	for (i = 0; i < loops; i++) {
-		mtx_enter(&s->mtx);
-		s->pv++;
-		mtx_leave(&s->mtx);
+	if (ts == NULL)
+		return;
+
+	c = cycles();
+	ts->state->lk->intr(ts);
+	ts->intr_cycles += cycles() - c;
+	ts->intrs++;
+
+	if (delay_conf.d_intr && delay_hit(&ts->irng)) {
+		delay_run();
+		ts->delays++;
 	}
+
+	errno = serrno;
 }
 
+#ifdef THREAD_RUSAGE
+/*
+ * add what the current thread used between start and end to the
+ * worker it is running for.
+ */
+
 static void
-check_inc_padded(struct state *s)
+tstate_rusage(struct tstate *ts, const struct rusage *start,
+    const struct rusage *end)
+{
+	struct timeval tv;
+
+	timersub(&end->ru_utime, &start->ru_utime, &tv);
+	timeradd(&ts->utime, &tv, &ts->utime);
+	timersub(&end->ru_stime, &start->ru_stime, &tv);
+	timeradd(&ts->stime, &tv, &ts->stime);
+	ts->nvcsw += end->ru_nvcsw - start->ru_nvcsw;
+	ts->nivcsw += end->ru_nivcsw - start->ru_nivcsw;
+}
+#endif
+
+/*
+ * -C fresh runs each burst on a new thread, which takes over the
+ * worker's tstate and cpu_info like a new process would on the same
+ * cpu. it inherits the worker's cpu binding.
+ */
+
+static void *
+churn_thread(void *arg)
 {
-	if (s->pv != s->loops * s->nthreads)
-		errx(1, "unexpected value %llu after workers finished", s->pv);
+	struct tstate *ts = arg;
+#ifdef THREAD_RUSAGE
+	struct rusage rustart, ruend;
+#endif
+
+	if (ts->flags & TS_TRACE)
+		trace_ring = &ts->trace;
+	cpu_info_self = &ts->ci;
+#ifdef LOCKSTAT
+	lockstat_thread = &ts->lockstat;
+#endif
+
+#ifdef THREAD_RUSAGE
+	if (getrusage(RUSAGE_THREAD, &rustart) == -1)
+		err(1, "getrusage thread %u", ts->id);
+#endif
+	ts->state->w->func(ts);
+#ifdef THREAD_RUSAGE
+	if (getrusage(RUSAGE_THREAD, &ruend) == -1)
+		err(1, "getrusage thread %u", ts->id);
+	tstate_rusage(ts, &rustart, &ruend);
+#endif
+
+	return (NULL);
 }
 
+/*
+ * run the work loop, or with -C, run it in bursts and stay away from
+ * the lock in between them.
+ */
+
 static void
-work_inc_wait(struct tstate *ts)
+work_run(struct tstate *ts)
 {
 	struct state *s = ts->state;
-	uint64_t i, c;
-	uint64_t loops = s->loops;
+	void *stacks[CHURN_NSTACKS] = { NULL };
+	void **stack;
+	pthread_attr_t attr;
+	pthread_t pth;
+	uint64_t loops = ts->loops;
+	unsigned int i;
+	int error;
 
-	for (i = 0; i < loops; i++) {
-		mtx_enter(&s->mtx);
-		s->v++;
-		for (c = 0; c < 100; c++)
-			CPU_BUSY_CYCLE();
-		mtx_leave(&s->mtx);
+	if (churn_conf.c_burst == 0) {
+		s->w->func(ts);
+		return;
 	}
+
+	while (ts->ops < loops && !READ_ONCE(s->stop)) {
+		ts->loops = ts->ops + churn_burst(&ts->rng);
+		if (ts->loops > loops)
+			ts->loops = loops;
+
+		atomic_inc_int_nv(&s->active);
+		if (churn_conf.c_fresh) {
+			/* don't let the next thread reuse the last stack */
+			stack = &stacks[ts->joins % CHURN_NSTACKS];
+			if (*stack == NULL) {
+				*stack = aligned_alloc(sysconf(_SC_PAGESIZE),
+				    CHURN_STACKSIZE);
+				if (*stack == NULL)
+					err(1, "thread %u stack", ts->id);
+			}
+
+			pthread_attr_init(&attr);
+			error = pthread_attr_setstack(&attr, *stack,
+			    CHURN_STACKSIZE);
+			if (error != 0)
+				errc(1, error, "thread %u stack", ts->id);
+			error = pthread_create(&pth, &attr, churn_thread, ts);
+			if (error != 0)
+				errc(1, error, "pthread_create %u churn",
+				    ts->id);
+			error = pthread_join(pth, NULL);
+			if (error != 0)
+				errc(1, error, "pthread_join %u churn", ts->id);
+			pthread_attr_destroy(&attr);
+		} else
+			s->w->func(ts);
+		atomic_dec_int_nv(&s->active);
+		ts->joins++;
+
+		churn_idle(&ts->rng);
+	}
+	ts->loops = loops;
+
+	for (i = 0; i < CHURN_NSTACKS; i++)
+		free(stacks[i]);
 }
 
-static void
-work_inc_wait_wait(struct tstate *ts)
+void *
+worker(void *arg)
 {
-	struct state *s = ts->state;
-	uint64_t i, c;
-	uint64_t loops = s->loops;
+	struct thread *t = arg;
+	struct state *s = t->state;
+	struct tstate *ts;
+#ifdef THREAD_RUSAGE
+	struct rusage rustart, ruend;
+#endif
+	unsigned int start = 0, warm = 0;
+	int perf = 0;
+
+	if (t->cpu != -1 && cpu_bind(pthread_self(), t->cpu) == -1)
+		err(1, "thread %u bind to cpu %d", t->id, t->cpu);
+
+	ts = tstate_alloc(t);
+	s->tsp[t->id] = ts;
+
+	if (ts->flags & TS_PERF)
+		perf = (perf_open(&ts->perf) == 0);
+	if (ts->flags & TS_TRACE)
+		trace_ring = &ts->trace;
+	cpu_info_attach(&ts->ci, ts->id);
+	if (ts->flags & TS_INTR)
+		intr_tstate = ts;
+#ifdef LOCKSTAT
+	lockstat_thread = &ts->lockstat;
+#endif
 
-	for (i = 0; i < loops; i++) {
-		mtx_enter(&s->mtx);
-		s->v++;
-		for (c = 0; c < 100; c++)
-			CPU_BUSY_CYCLE();
-		mtx_leave(&s->mtx);
-		for (c = 0; c < 100; c++)
-			CPU_BUSY_CYCLE();
+	barrier_wait(&s->start, &start);
+
+	if (s->warmup > 0) {
+		ts->loops = s->warmup;
+		work_run(ts);
+		tstate_reset(ts);
+		ts->loops = s->loops;
+
+		barrier_wait(&s->warm, &warm);
+		if (ts->id == 0) {
+			/* the checks only count the timed loops */
+			s->v = s->pv = 0;
+			s->releaser = UINT_MAX;
+		}
+		barrier_wait(&s->warm, &warm);
 	}
+
+	if (perf)
+		perf_start(&ts->perf);
+#ifdef THREAD_RUSAGE
+	if (getrusage(RUSAGE_THREAD, &rustart) == -1)
+		err(1, "getrusage thread %u", ts->id);
+#endif
+
+	ts->began = timestamp();
+	if (atomic_inc_int_nv(&s->started) == s->nthreads) {
+		s->wopen = ts->began;
+		s->wopen_ops = state_ops(s);
+	}
+
+	work_run(ts);
+
+	/* the interrupts stop with the work */
+	if (ts->flags & TS_INTR)
+		(void)intr_disable();
+
+	ts->ended = timestamp();
+	if (atomic_inc_int_nv(&s->finished) == 1) {
+		s->wclose = ts->ended;
+		s->wclose_ops = state_ops(s);
+	}
+
+#ifdef THREAD_RUSAGE
+	if (getrusage(RUSAGE_THREAD, &ruend) == -1)
+		err(1, "getrusage thread %u", ts->id);
+	tstate_rusage(ts, &rustart, &ruend);
+#endif
+
+	if (perf)
+		perf_stop(&ts->perf);
+
+	return (NULL);
 }
 
-static void
-work_inc_unbalanced(struct tstate *ts)
+static void time2ival(time_t);
+
+/*
+ * -I interrupts every worker each period, until they're all done.
+ */
+
+struct intr {
+	struct state		*state;
+	struct thread		*threads;
+	int			 nthreads;
+	unsigned int		 period;	/* usec */
+	pthread_t		 pth;
+};
+
+static void *
+intr_thread(void *arg)
 {
-	struct state *s = ts->state;
-	uint64_t i, c;
-	uint64_t loops = s->loops;
-	int slow = (ts->id == 0);
-
-	for (i = 0; i < loops; i++) {
-		mtx_enter(&s->mtx);
-		s->v++;
-		if (slow) {
-			for (c = 0; c < 100; c++)
-				CPU_BUSY_CYCLE();
+	struct intr *it = arg;
+	struct state *s = it->state;
+	struct timespec ival;
+	int i, error;
+
+	ival.tv_sec = it->period / 1000000;
+	ival.tv_nsec = (it->period % 1000000) * 1000;
+
+	/* only interrupt the timed part of the run */
+	while (READ_ONCE(s->started) < s->nthreads)
+		pthread_yield();
+
+	while (READ_ONCE(s->finished) < s->nthreads) {
+		nanosleep(&ival, NULL);
+
+		for (i = 0; i < it->nthreads; i++) {
+			error = pthread_kill(it->threads[i].pth, INTR_SIGNAL);
+			if (error != 0 && error != ESRCH)
+				errc(1, error, "interrupt %d", i);
 		}
-		mtx_leave(&s->mtx);
 	}
+
+	return (NULL);
 }
 
 /*
- * access to a "resource" is protected by a mutex.
+ * the sampler periodically adds up how many loops the workers have
+ * done so throughput can be reported over time instead of only as
+ * an average over the whole run.
+ */
+
+struct sampler {
+	struct state		*state;
+	int			 nthreads;
+	unsigned int		 interval;	/* msec */
+	pthread_t		 pth;
+
+	uint64_t		*rates;		/* ops/sec */
+	unsigned int		*active;	/* -C: workers in a burst */
+	size_t			 nrates;
+};
+
+static uint64_t
+sampler_ops(const struct sampler *sm)
+{
+	uint64_t ops = 0;
+	int i;
+
+	for (i = 0; i < sm->nthreads; i++)
+		ops += READ_ONCE(sm->state->tsp[i]->ops);
+
+	return (ops);
+}
+
+static void *
+sampler(void *arg)
+{
+	struct sampler *sm = arg;
+	struct state *s = sm->state;
+	struct timespec ival, next, then, now, diff;
+	uint64_t ops, lops = 0;
+	uint64_t ns;
+	size_t nalloc = 0;
+	uint64_t *rates;
+	unsigned int *active;
+
+	ival.tv_sec = sm->interval / 1000;
+	ival.tv_nsec = (sm->interval % 1000) * 1000000;
+
+	/* only sample the timed part of the run */
+	while (READ_ONCE(s->started) < s->nthreads)
+		pthread_yield();
+	lops = sampler_ops(sm);
+
+	if (clock_gettime(CLOCK_MONOTONIC, &then) == -1)
+		err(1, "sampler start");
+	next = then;
+
+	while (!READ_ONCE(s->stop)) {
+		timespecadd(&next, &ival, &next);
+
+		if (clock_gettime(CLOCK_MONOTONIC, &now) == -1)
+			err(1, "sampler now");
+		if (timespeccmp(&next, &now, >)) {
+			timespecsub(&next, &now, &diff);
+			nanosleep(&diff, NULL);
+		}
+
+		/* don't count the tail end of the run as an interval */
+		if (READ_ONCE(s->stop))
+			break;
+
+		ops = sampler_ops(sm);
+		if (clock_gettime(CLOCK_MONOTONIC, &now) == -1)
+			err(1, "sampler now");
+
+		timespecsub(&now, &then, &diff);
+		ns = diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+
+		if (sm->nrates == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			rates = reallocarray(sm->rates, nalloc,
+			    sizeof(*rates));
+			if (rates == NULL)
+				err(1, "sampler rates");
+			sm->rates = rates;
+
+			active = reallocarray(sm->active, nalloc,
+			    sizeof(*active));
+			if (active == NULL)
+				err(1, "sampler active");
+			sm->active = active;
+		}
+		sm->active[sm->nrates] = READ_ONCE(s->active);
+		sm->rates[sm->nrates++] = ns ?
+		    (double)(ops - lops) * 1000000000.0 / ns : 0;
+
+		lops = ops;
+		then = now;
+	}
+
+	return (NULL);
+}
+
+/*
+ * work out how fast cycles() ticks so it can be turned into time.
+ */
+
+static uint64_t cycles_hz;
+
+static void
+cycles_calibrate(void)
+{
+	struct timespec tick, tock, diff;
+	uint64_t c0, c1, ns;
+
+#ifdef MTX_SIM
+	cycles_hz = sim_hz();
+	return;
+#endif
+
+	if (clock_gettime(CLOCK_MONOTONIC, &tick) == -1)
+		err(1, "calibrate tick");
+	c0 = cycles();
+
+	do {
+		if (clock_gettime(CLOCK_MONOTONIC, &tock) == -1)
+			err(1, "calibrate tock");
+		timespecsub(&tock, &tick, &diff);
+		ns = diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+	} while (ns < 20000000);
+
+	c1 = cycles();
+
+	cycles_hz = (c1 - c0) * 1000000000ULL / ns;
+}
+
+static uint64_t
+cycles2ns(uint64_t c)
+{
+	return ((double)c * 1000000000.0 / cycles_hz);
+}
+
+static void
+print_hist(const char *name, const struct hist *h)
+{
+	printf("\"%s\":{", name);
+	printf("\"p50\":%llu,", cycles2ns(hist_quantile(h, 0.50)));
+	printf("\"p90\":%llu,", cycles2ns(hist_quantile(h, 0.90)));
+	printf("\"p99\":%llu,", cycles2ns(hist_quantile(h, 0.99)));
+	printf("\"p99.9\":%llu,", cycles2ns(hist_quantile(h, 0.999)));
+	printf("\"max\":%llu", cycles2ns(h->h_max));
+	printf("}");
+}
+
+/*
+ * report how evenly the lock was shared between the threads.
  *
- * threads coordinate via a mutex to take ownership of a "resource",
- * which they then operate on outside the mutex, before taking the
- * mutex again to return it.
+ * jain's fairness index is 1 when every thread got the lock the same
+ * number of times, and 1/n when one thread got it every time. minmax
+ * is the ratio of the fewest acquisitions by a thread to the most.
  */
 
 static void
-work_inc_res(struct tstate *ts)
+print_fairness(struct tstate *const *tsp, int nthreads)
 {
-	struct state *s = ts->state;
-	uint64_t i;
-	uint64_t loops = s->loops;
-	uint64_t v;
+	const struct tstate *ts;
+	double sum = 0.0, sumsq = 0.0;
+	double jain = 1.0, minmax = 1.0;
+	uint64_t min = UINT64_MAX, max = 0;
+	uint64_t maxwait = 0;
+	int i;
+
+	printf("\"acquisitions\":[");
+	for (i = 0; i < nthreads; i++) {
+		ts = tsp[i];
+
+		printf("%s%llu", i ? "," : "", ts->acquisitions);
 
-	for (i = 0; i < loops; i++) {
-		do {
-			mtx_enter(&s->mtx);
-			v = s->v;
-			if (v == 0)
-				s->v = 1;
-			mtx_leave(&s->mtx);
-		} while (v != 0);
+		sum += ts->acquisitions;
+		sumsq += (double)ts->acquisitions * ts->acquisitions;
+		if (ts->acquisitions < min)
+			min = ts->acquisitions;
+		if (ts->acquisitions > max)
+			max = ts->acquisitions;
+	}
+	printf("],");
 
-		s->pv++;
+	if (tsp[0]->flags & TS_TIMING) {
+		printf("\"waited\":[");
+		for (i = 0; i < nthreads; i++) {
+			ts = tsp[i];
 
-		mtx_enter(&s->mtx);
-		s->v = 0;
-		mtx_leave(&s->mtx);
+			printf("%s%llu", i ? "," : "",
+			    cycles2ns(ts->wait.h_sum));
+			if (ts->wait.h_max > maxwait)
+				maxwait = ts->wait.h_max;
+		}
+		printf("],");
 	}
+
+	if (sumsq > 0.0)
+		jain = (sum * sum) / (nthreads * sumsq);
+	if (max > 0)
+		minmax = (double)min / max;
+
+	printf("\"fairness\":{");
+	printf("\"jain\":%.4f,", jain);
+	printf("\"minmax\":%.4f", minmax);
+	if (tsp[0]->flags & TS_TIMING)
+		printf(",\"max_wait\":%llu", cycles2ns(maxwait));
+	printf("}");
 }
 
+#ifdef THREAD_RUSAGE
 /*
- * arc4random takes 4 bytes at a time from a cryptographic stream cipher.
- * the stream cipher produces a lot more than 4 bytes at a time, so the
- * runtime of individual arc4random calls can vary. they're either short
- * or long.
+ * a spinning lock falls over when the thread holding it, or the one
+ * it is being handed to, is preempted. how often each thread was
+ * preempted in the timed loop shows when that is happening.
  */
 
 static void
-work_arc4random(struct tstate *ts)
+print_preemption(struct tstate *const *tsp, int nthreads)
 {
-	struct state *s = ts->state;
-	uint64_t i;
-	uint64_t loops = s->loops;
-	uint64_t v;
+	uint64_t total = 0, max = 0;
+	int i;
 
-	for (i = 0; i < loops; i++) {
-		mtx_enter(&s->mtx);
-		arc4random();
-		mtx_leave(&s->mtx);
+	printf("\"preemption\":{");
+	printf("\"nivcsw\":[");
+	for (i = 0; i < nthreads; i++) {
+		printf("%s%llu", i ? "," : "", tsp[i]->nivcsw);
+		total += tsp[i]->nivcsw;
+		if (tsp[i]->nivcsw > max)
+			max = tsp[i]->nivcsw;
 	}
+	printf("],");
+	printf("\"total\":%llu,", total);
+	printf("\"max\":%llu", max);
+	printf("}");
 }
+#endif
 
 /*
- * use the result of arc4random as a delay time before attempting
- * to retake the lock.
+ * add up the performance counters from all the threads, and report
+ * them per lock acquisition. an event is only reported if it could
+ * be counted on every thread.
  */
 
 static void
-work_arc4random_wait(struct tstate *ts)
+print_perf(struct tstate *const *tsp, int nthreads)
 {
-	struct state *s = ts->state;
-	uint64_t i;
-	uint64_t loops = s->loops;
-	uint64_t v;
-	uint32_t w;
+	const struct tstate *ts;
+	uint64_t acquisitions = 0;
+	uint64_t total;
+	unsigned int e, n = 0;
+	int i;
 
-	for (i = 0; i < loops; i++) {
-		mtx_enter(&s->mtx);
-		w = arc4random();
-		mtx_leave(&s->mtx);
+	for (i = 0; i < nthreads; i++)
+		acquisitions += tsp[i]->acquisitions;
+
+	printf("\"perf\":{");
+	for (e = 0; e < perf_nevents(); e++) {
+		total = 0;
+		for (i = 0; i < nthreads; i++) {
+			ts = tsp[i];
+			if (e >= ts->perf.p_nfds || ts->perf.p_fds[e] == -1)
+				break;
+			total += ts->perf.p_counts[e];
+		}
+		if (i < nthreads)
+			continue;
 
-		w &= 0xfff;
+		printf("%s\"%s\":%.3f", n++ ? "," : "", perf_name(e),
+		    acquisitions ? (double)total / acquisitions : 0.0);
+	}
+	printf("}");
 
-		while (w > 0) {
-			CPU_BUSY_CYCLE();
-			w--;
-		}
+	if (n == 0)
+		warnx("performance counters are not available");
+}
+
+#ifdef LOCKSTAT
+static void
+print_lockstat(struct tstate *const *tsp, int nthreads)
+{
+	static const char *names[] = LOCKSTAT_NAMES;
+	uint64_t total;
+	unsigned int c;
+	int i;
+
+	printf("\"lockstat\":{");
+	for (c = 0; c < LS_NCOUNTERS; c++) {
+		total = 0;
+		for (i = 0; i < nthreads; i++)
+			total += tsp[i]->lockstat.ls_counters[c];
+
+		printf("%s\"%s\":%llu", c ? "," : "", names[c], total);
 	}
+	printf("}");
 }
+#endif
+
+/*
+ * report how much cpu the run used, and how much it cost per loop.
+ */
 
 static void
-check_arc4random(struct state *s)
+print_rusage(const struct rusage *ru, const struct timespec *diff,
+    uint64_t ncycles, uint64_t ops)
 {
-	/* nop */
+	double cpu, wall;
+
+	cpu = ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1000000.0 +
+	    ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1000000.0;
+	wall = diff->tv_sec + diff->tv_nsec / 1000000000.0;
+
+	printf("\"utime\":%lld.%03ld,", (long long)ru->ru_utime.tv_sec,
+	    (long)ru->ru_utime.tv_usec / 1000);
+	printf("\"stime\":%lld.%03ld,", (long long)ru->ru_stime.tv_sec,
+	    (long)ru->ru_stime.tv_usec / 1000);
+	printf("\"nvcsw\":%ld,", ru->ru_nvcsw);
+	printf("\"nivcsw\":%ld,", ru->ru_nivcsw);
+	printf("\"cpu_per_mop\":%.6f", ops ? cpu * 1000000.0 / ops : 0.0);
+#ifdef CYCLES_CORE
+	/* turn cpu time into cycles at the rate they ticked during the run */
+	if (ops > 0 && wall > 0.0) {
+		printf(",\"cycles_per_op\":%.1f",
+		    cpu * (ncycles / wall) / ops);
+	}
+#endif
 }
 
-struct work {
-	const char *name;
-	void (*func)(struct tstate *);
-	void (*check)(struct state *);
+/*
+ * how the harness has been asked to run the work.
+ */
+
+struct opts {
+	uint64_t		 loops;
+	uint64_t		 warmup;	/* loops */
+	unsigned int		 seconds;
+	unsigned int		 interval;	/* msec */
+	int			 flags;		/* TS_* */
+	FILE			*tf;
+	unsigned int		 intr;		/* -I usec, 0 only masks */
+	int			 delay;		/* -D, see delay_conf */
+	int			 noise;		/* -N, see noise_conf */
+
+	int			 navail;	/* cpus the threads can use */
+	const char		*placement;	/* -p policy or cpu list */
+	int			*place;		/* thread i runs on place[i % n] */
+	size_t			 nplace;
 };
 
-static const struct work workers[] = {
-	{ "inc",	work_inc,		 check_inc },
-	{ "inc-padded",	work_inc_padded,	 check_inc_padded },
-	{ "inc-wait",	work_inc_wait,		 check_inc },
-	{ "inc-wait-wait",
-			work_inc_wait_wait,	 check_inc },
-	{ "inc-unbalanced",
-			work_inc_unbalanced,	 check_inc },
-	{ "res",	work_inc_res,		 check_inc_padded },
-	{ "arc4random",	work_arc4random,	 check_arc4random },
-	{ "arc4random-wait",
-			work_arc4random_wait,	 check_arc4random },
+static void
+print_placement(const struct opts *o, int nthreads)
+{
+	int i;
+
+	printf("\"placement\":{");
+	printf("\"policy\":\"%s\",", o->placement);
+	printf("\"cpus\":[");
+	for (i = 0; i < nthreads; i++)
+		printf("%s%d", i ? "," : "", o->place[i % o->nplace]);
+	printf("]");
+	printf("}");
+}
+
+/*
+ * the numbers from a run that a sweep summarises.
+ */
+
+struct result {
+	double			 time;
+	double			 ops_per_sec;
+	double			 wait_p99;	/* nsec */
+	double			 wait_max;	/* nsec */
+	double			 nivcsw;
 };
 
-void *
-worker(void *arg)
+#ifndef THREAD_RUSAGE
+static void
+rusage_sub(const struct rusage *a, const struct rusage *b,
+    struct rusage *r)
 {
-	struct tstate *ts = arg;
-	struct state *s = ts->state;
+	timersub(&a->ru_utime, &b->ru_utime, &r->ru_utime);
+	timersub(&a->ru_stime, &b->ru_stime, &r->ru_stime);
+	r->ru_nvcsw = a->ru_nvcsw - b->ru_nvcsw;
+	r->ru_nivcsw = a->ru_nivcsw - b->ru_nivcsw;
+}
+#endif
 
-	while (s->bar)
-		pthread_yield();
+/*
+ * run the work with nthreads, and the -N noise threads if noisy is
+ * set. if res is NULL, the results are printed
+ * as a json object, otherwise they're returned via res.
+ */
 
-	s->w->func(ts);
+static void
+run(const struct opts *o, const struct lock *lk, const struct work *w,
+    int nthreads, int noisy, struct result *res)
+{
+	struct state s;
+	struct thread *threads;
+	struct tstate **tsp;
+	struct sampler sm = { .interval = o->interval };
+	struct intr it = { .period = o->intr };
+	struct hist *wait = NULL, *hold = NULL, *handoffs = NULL;
+	struct timespec tick, tock, diff, duration;
+	uint64_t ctick, ctock;
+#ifndef THREAD_RUSAGE
+	struct rusage rustart, ruend;
+	struct timespec nrt;
+	struct timeval nrv;
+#endif
+	struct rusage ru;
+	uint64_t loops = o->loops;
+	uint64_t wtime, wops, began, ended, sbegan, sended;
+	uint64_t spinouts, intrs, intr_cycles, delays, joins;
+	double rate;
+	int timing = o->flags & TS_TIMING;
+	int handoff = o->flags & TS_HANDOFF;
+	unsigned int start = 0;
+	int i, error;
+	size_t r;
+
+#ifdef MTX_SIM
+	/* the main thread isn't a virtual cpu, so it can't wait */
+	barrier_init(&s.start, nthreads);
+#else
+	barrier_init(&s.start, nthreads + 1);
+#endif
+	barrier_init(&s.warm, nthreads);
+	s.warmup = o->warmup;
+	s.started = s.finished = 0;
+	s.stop = 0;
+	lk->init(s.mtx);
+	lk->init(s.imtx);
+	s.intrs = 0;
+	s.active = 0;
+	s.lk = lk;
+	s.loops = loops;
+	s.nthreads = nthreads;
+	s.v = s.pv = 0;
+	s.w = w;
 
-	return (NULL);
+	s.released = 0;
+	s.releaser = UINT_MAX;
+
+	if (timing) {
+		wait = calloc(1, sizeof(*wait));
+		hold = calloc(1, sizeof(*hold));
+		if (wait == NULL || hold == NULL)
+			err(1, "histogram calloc");
+	}
+	if (handoff) {
+		handoffs = calloc(1, sizeof(*handoffs));
+		if (handoffs == NULL)
+			err(1, "handoff histogram calloc");
+	}
+
+	if (res == NULL) {
+		if (o->seconds > 0) {
+			warnx("starting %d threads for %u seconds",
+			    nthreads, o->seconds);
+		} else {
+			warnx("starting %d threads for %llu loops",
+			    nthreads, loops);
+		}
+	}
+
+	/* the neighbours are already making noise when the workers start */
+	if (noisy)
+		noise_start();
+
+	threads = calloc(nthreads, sizeof(*threads));
+	tsp = calloc(nthreads, sizeof(*tsp));
+	if (threads == NULL || tsp == NULL)
+		err(1, "threads alloc");
+	s.tsp = tsp;
+
+	for (i = 0; i < nthreads; i++) {
+		struct thread *t = &threads[i];
+
+		t->state = &s;
+		t->id = i;
+		t->cpu = o->nplace > 0 ? o->place[i % o->nplace] : -1;
+		t->flags = o->flags;
+
+#ifdef MTX_SIM
+		if (sim_spawn(worker, t) == -1)
+			err(1, "sim cpu %d", i);
+#else
+		error = pthread_create(&t->pth, NULL, worker, t);
+		if (error != 0)
+			errc(1, error, "pthread_create %d", i);
+#endif
+	}
+
+	if ((o->flags & TS_INTR) && it.period > 0) {
+		it.state = &s;
+		it.threads = threads;
+		it.nthreads = nthreads;
+
+		error = pthread_create(&it.pth, NULL, intr_thread, &it);
+		if (error != 0)
+			errc(1, error, "pthread_create intr");
+	}
+
+	if (sm.interval > 0) {
+		sm.state = &s;
+		sm.nthreads = nthreads;
+
+		error = pthread_create(&sm.pth, NULL, sampler, &sm);
+		if (error != 0)
+			errc(1, error, "pthread_create sampler");
+	}
+
+#ifndef THREAD_RUSAGE
+	if (getrusage(RUSAGE_SELF, &rustart) == -1)
+		err(1, "getrusage self");
+#endif
+	if (clock_gettime(CLOCK_MONOTONIC, &tick) == -1)
+		err(1, "tick");
+	ctick = cycles();
+
+#ifdef MTX_SIM
+	sim_run();
+#else
+	barrier_wait(&s.start, &start);
+#endif
+
+	if (o->seconds > 0) {
+		/* don't count the warmup against the time */
+		while (READ_ONCE(s.started) < nthreads)
+			pthread_yield();
+
+		duration.tv_sec = o->seconds;
+		duration.tv_nsec = 0;
+		while (nanosleep(&duration, &duration) == -1) {
+			if (errno != EINTR)
+				err(1, "nanosleep");
+		}
+
+		s.stop = 1;
+	}
+
+	s.ops = 0;
+
+	/* stop interrupting the workers before they're joined */
+	if ((o->flags & TS_INTR) && it.period > 0) {
+		error = pthread_join(it.pth, NULL);
+		if (error != 0)
+			errc(1, error, "pthread_join intr");
+	}
+
+#ifndef MTX_SIM
+	for (i = 0; i < nthreads; i++) {
+		void *v;
+
+		error = pthread_join(threads[i].pth, &v);
+		if (error != 0)
+			errc(1, error, "pthread_join %d", i);
+		if (v != NULL)
+			errx(1, "pthread_join %i unexpected value %p", i, v);
+	}
+#endif
+	ctock = cycles();
+	if (clock_gettime(CLOCK_MONOTONIC, &tock) == -1)
+		err(1, "tock");
+
+	/* merging the histograms isn't part of the run */
+	for (i = 0; i < nthreads; i++) {
+		struct tstate *ts = tsp[i];
+
+		s.ops += ts->ops;
+
+		if (timing) {
+			hist_merge(wait, &ts->wait);
+			hist_merge(hold, &ts->hold);
+		}
+		if (handoff)
+			hist_merge(handoffs, &ts->handoffs);
+	}
+	if (noisy)
+		noise_stop();
+
+	if (sm.interval > 0) {
+		s.stop = 1;
+
+		error = pthread_join(sm.pth, NULL);
+		if (error != 0)
+			errc(1, error, "pthread_join sampler");
+	}
+
+#ifdef THREAD_RUSAGE
+	/* only count the workers, not the harness or -N threads */
+	memset(&ru, 0, sizeof(ru));
+	for (i = 0; i < nthreads; i++) {
+		timeradd(&ru.ru_utime, &tsp[i]->utime, &ru.ru_utime);
+		timeradd(&ru.ru_stime, &tsp[i]->stime, &ru.ru_stime);
+		ru.ru_nvcsw += tsp[i]->nvcsw;
+		ru.ru_nivcsw += tsp[i]->nivcsw;
+	}
+#else
+	if (getrusage(RUSAGE_SELF, &ruend) == -1)
+		err(1, "getrusage self");
+	rusage_sub(&ruend, &rustart, &ru);
+	if (noisy) {
+		/* most of what the -N threads do is in userland */
+		noise_runtime(&nrt);
+		nrv.tv_sec = nrt.tv_sec;
+		nrv.tv_usec = nrt.tv_nsec / 1000;
+		if (timercmp(&ru.ru_utime, &nrv, >))
+			timersub(&ru.ru_utime, &nrv, &ru.ru_utime);
+		else
+			timerclear(&ru.ru_utime);
+	}
+#endif
+
+	w->check(&s);
+
+	intrs = intr_cycles = 0;
+	for (i = 0; i < nthreads; i++) {
+		intrs += tsp[i]->intrs;
+		intr_cycles += tsp[i]->intr_cycles;
+	}
+	if (s.intrs != intrs) {
+		errx(1, "interrupt handlers counted %llu, expected %llu",
+		    s.intrs, intrs);
+	}
+
+	timespecsub(&tock, &tick, &diff);
+#ifdef MTX_SIM
+	/* report how long it took the virtual cpus */
+	diff.tv_sec = cycles2ns(ctock - ctick) / 1000000000ULL;
+	diff.tv_nsec = cycles2ns(ctock - ctick) % 1000000000ULL;
+#endif
+
+	/*
+	 * threads that start early or finish late get the lock to
+	 * themselves, so only count the ops done while they were all
+	 * running. fall back to the whole run if they never were.
+	 */
+	sbegan = began = tsp[0]->began;
+	sended = ended = tsp[0]->ended;
+	for (i = 1; i < nthreads; i++) {
+		if (tsp[i]->began < began)
+			began = tsp[i]->began;
+		if (tsp[i]->began > sbegan)
+			sbegan = tsp[i]->began;
+		if (tsp[i]->ended < ended)
+			ended = tsp[i]->ended;
+		if (tsp[i]->ended > sended)
+			sended = tsp[i]->ended;
+	}
+
+	wtime = wops = 0;
+	if (s.wclose > s.wopen && s.wclose_ops > s.wopen_ops) {
+		wtime = s.wclose - s.wopen;
+		wops = s.wclose_ops - s.wopen_ops;
+		rate = wops * 1000000000.0 / wtime;
+	} else
+		rate = s.ops / (diff.tv_sec + diff.tv_nsec / 1000000000.0);
+
+	if (res != NULL) {
+		res->time = diff.tv_sec + diff.tv_nsec / 1000000000.0;
+		res->ops_per_sec = rate;
+		res->wait_p99 = timing ?
+		    cycles2ns(hist_quantile(wait, 0.99)) : 0.0;
+		res->wait_max = timing ? cycles2ns(wait->h_max) : 0.0;
+		res->nivcsw = 0.0;
+		for (i = 0; i < nthreads; i++)
+			res->nivcsw += tsp[i]->nivcsw;
+		goto free;
+	}
+
+	printf("{");
+	printf("\"lock\":\"%s\",", lk->name);
+	printf("\"work\":\"%s\",", w->name);
+	if (o->seconds > 0)
+		printf("\"seconds\":%u,", o->seconds);
+	else
+		printf("\"loops\":%llu,", loops);
+	printf("\"nthreads\":%d,", nthreads);
+#ifndef MTX_SIM
+	printf("\"ncpus\":%d,", o->navail);
+#endif
+	if (o->placement != NULL) {
+		print_placement(o, nthreads);
+		printf(",");
+	}
+	printf("\"time\":%lld.%03ld,", diff.tv_sec, diff.tv_nsec / 1000000);
+	printf("\"ops\":%llu,", s.ops);
+	printf("\"ops_per_sec\":%.0f,", rate);
+	if (s.warmup > 0)
+		printf("\"warmup\":%llu,", s.warmup);
+	printf("\"window\":{");
+	printf("\"time\":%.6f,", wtime / 1000000000.0);
+	printf("\"ops\":%llu,", wops);
+	printf("\"start_skew\":%llu,", sbegan - began);
+	printf("\"end_skew\":%llu", sended - ended);
+	printf("},");
+	spin_print();
+	printf(",");
+	if (sm.interval > 0) {
+		printf("\"interval\":%u,", sm.interval);
+		printf("\"series\":[");
+		for (r = 0; r < sm.nrates; r++)
+			printf("%s%llu", r ? "," : "", sm.rates[r]);
+		printf("],");
+		if (churn_conf.c_burst > 0) {
+			printf("\"contenders\":[");
+			for (r = 0; r < sm.nrates; r++)
+				printf("%s%u", r ? "," : "", sm.active[r]);
+			printf("],");
+		}
+	}
+#ifdef MTX_SIM
+	sim_print();
+#else
+	print_rusage(&ru, &diff, ctock - ctick, s.ops);
+#endif
+	printf(",");
+	print_fairness(tsp, nthreads);
+#ifdef THREAD_RUSAGE
+	printf(",");
+	print_preemption(tsp, nthreads);
+#endif
+	/* only the locks using the emulated cpu_info count these */
+	spinouts = 0;
+	for (i = 0; i < nthreads; i++)
+		spinouts += tsp[i]->ci.ci_spinouts;
+	if (spinouts > 0)
+		printf(",\"spinouts\":%llu", spinouts);
+	if (o->delay) {
+		delays = 0;
+		for (i = 0; i < nthreads; i++)
+			delays += tsp[i]->delays;
+		printf(",");
+		delay_print();
+		printf(",\"ndelays\":%llu", delays);
+	}
+	if (churn_conf.c_burst > 0) {
+		joins = 0;
+		for (i = 0; i < nthreads; i++)
+			joins += tsp[i]->joins;
+		printf(",");
+		churn_print();
+		printf(",\"njoins\":%llu", joins);
+	}
+	if (o->noise) {
+		printf(",");
+		if (noisy)
+			noise_print(1);
+		else
+			printf("\"noise\":null");
+	}
+	if (o->flags & TS_INTR) {
+		printf(",\"interrupts\":{");
+		printf("\"period\":%u,", o->intr);
+		printf("\"count\":%llu,", intrs);
+		printf("\"handler_ns\":%llu",
+		    intrs ? cycles2ns(intr_cycles / intrs) : 0);
+		printf("}");
+	}
+	if (timing) {
+		printf(",");
+		print_hist("wait", wait);
+		printf(",");
+		print_hist("hold", hold);
+	}
+	if (handoff) {
+		printf(",\"nhandoffs\":%llu,", handoffs->h_count);
+		print_hist("handoff", handoffs);
+	}
+	if (o->flags & TS_PERF) {
+		printf(",");
+		print_perf(tsp, nthreads);
+	}
+#ifdef LOCKSTAT
+	printf(",");
+	print_lockstat(tsp, nthreads);
+#endif
+	printf("}\n");
+
+	if (o->tf != NULL) {
+		trace_export_begin(o->tf);
+		for (i = 0; i < nthreads; i++) {
+			trace_export_thread(o->tf, &tsp[i]->trace, i,
+			    ctick, cycles_hz);
+		}
+		trace_export_end(o->tf);
+	}
+
+free:
+	for (i = 0; i < nthreads; i++) {
+		free(tsp[i]->trace.tr_events);
+		free(tsp[i]);
+	}
+	free(tsp);
+	free(threads);
+	free(sm.rates);
+	free(sm.active);
+	free(wait);
+	free(hold);
+	free(handoffs);
 }
 
-static void time2ival(time_t);
+/*
+ * sweeps run every combination of work and nthreads several times,
+ * in a random order so that things like the machine warming up or
+ * something else running on it don't consistently favour one of
+ * them. warmup runs are done first and thrown away.
+ */
+
+struct point {
+	const struct lock	*lk;
+	const struct work	*w;
+	int			 nthreads;
+	int			 noisy;		/* -N */
+	struct result		*results;
+	size_t			 nresults;
+};
+
+static void
+shuffle(size_t *v, size_t n)
+{
+	size_t i, j, t;
+
+	for (i = n; i > 1; i--) {
+		j = arc4random_uniform(i);
+		t = v[i - 1];
+		v[i - 1] = v[j];
+		v[j] = t;
+	}
+}
+
+static void
+print_summary(const char *name, const double *v, size_t n)
+{
+	struct summary sum;
+	size_t i;
+
+	summarise(v, n, &sum);
+
+	printf("\"%s\":{", name);
+	printf("\"median\":%.6g,", sum.median);
+	printf("\"mad\":%.6g,", sum.mad);
+	printf("\"ci95\":[%.6g,%.6g],", sum.lo, sum.hi);
+	printf("\"runs\":[");
+	for (i = 0; i < n; i++)
+		printf("%s%.6g", i ? "," : "", v[i]);
+	printf("]");
+	printf("}");
+}
+
+static void
+sweep(const struct opts *o, struct point *points, size_t npoints,
+    unsigned int reps, unsigned int warmups)
+{
+	struct point *pt;
+	struct result scratch;
+	size_t *order;
+	size_t ntrials = npoints * reps;
+	double *v;
+	size_t i, j;
+	unsigned int r;
+
+	order = reallocarray(NULL, ntrials > npoints ? ntrials : npoints,
+	    sizeof(*order));
+	if (order == NULL)
+		err(1, "sweep order");
+
+	warnx("sweeping %zu points, %u warmups and %u reps each",
+	    npoints, warmups, reps);
+
+	for (r = 0; r < warmups; r++) {
+		for (i = 0; i < npoints; i++)
+			order[i] = i;
+		shuffle(order, npoints);
+
+		for (i = 0; i < npoints; i++) {
+			pt = &points[order[i]];
+			run(o, pt->lk, pt->w, pt->nthreads, pt->noisy,
+			    &scratch);
+		}
+	}
+
+	for (i = 0; i < npoints; i++) {
+		pt = &points[i];
+		pt->results = reallocarray(NULL, reps, sizeof(*pt->results));
+		if (pt->results == NULL)
+			err(1, "sweep results");
+		pt->nresults = 0;
+
+		for (r = 0; r < reps; r++)
+			order[i * reps + r] = i;
+	}
+	shuffle(order, ntrials);
+
+	for (i = 0; i < ntrials; i++) {
+		pt = &points[order[i]];
+		run(o, pt->lk, pt->w, pt->nthreads, pt->noisy,
+		    &pt->results[pt->nresults++]);
+	}
+
+	v = reallocarray(NULL, reps, sizeof(*v));
+	if (v == NULL)
+		err(1, "sweep values");
+
+	for (i = 0; i < npoints; i++) {
+		pt = &points[i];
+
+		printf("{");
+		printf("\"lock\":\"%s\",", pt->lk->name);
+		printf("\"work\":\"%s\",", pt->w->name);
+		if (o->seconds > 0)
+			printf("\"seconds\":%u,", o->seconds);
+		else
+			printf("\"loops\":%llu,", o->loops);
+		printf("\"nthreads\":%d,", pt->nthreads);
+#ifndef MTX_SIM
+		printf("\"ncpus\":%d,", o->navail);
+#endif
+		if (o->placement != NULL) {
+			print_placement(o, pt->nthreads);
+			printf(",");
+		}
+		if (o->flags & TS_INTR)
+			printf("\"interrupts\":{\"period\":%u},", o->intr);
+		if (o->delay) {
+			delay_print();
+			printf(",");
+		}
+		if (churn_conf.c_burst > 0) {
+			churn_print();
+			printf(",");
+		}
+		if (o->noise) {
+			if (pt->noisy)
+				noise_print(0);
+			else
+				printf("\"noise\":null");
+			printf(",");
+		}
+		printf("\"reps\":%u,", reps);
+		printf("\"warmups\":%u,", warmups);
+		if (o->warmup > 0)
+			printf("\"warmup\":%llu,", o->warmup);
+		spin_print();
+		printf(",");
+
+		for (j = 0; j < pt->nresults; j++)
+			v[j] = pt->results[j].time;
+		print_summary("time", v, pt->nresults);
+		printf(",");
+		for (j = 0; j < pt->nresults; j++)
+			v[j] = pt->results[j].ops_per_sec;
+		print_summary("ops_per_sec", v, pt->nresults);
+		if (o->flags & TS_TIMING) {
+			printf(",");
+			for (j = 0; j < pt->nresults; j++)
+				v[j] = pt->results[j].wait_p99;
+			print_summary("wait_p99", v, pt->nresults);
+			printf(",");
+			for (j = 0; j < pt->nresults; j++)
+				v[j] = pt->results[j].wait_max;
+			print_summary("wait_max", v, pt->nresults);
+		}
+#ifdef THREAD_RUSAGE
+		printf(",");
+		for (j = 0; j < pt->nresults; j++)
+			v[j] = pt->results[j].nivcsw;
+		print_summary("nivcsw", v, pt->nresults);
+#endif
+		printf("}\n");
+
+		free(pt->results);
+	}
+
+	free(v);
+	free(order);
+}
+
+/*
+ * parse a list of thread counts, eg, "1-4,8,16".
+ */
+
+static int *
+parse_nthreads(const char *arg, int max, size_t *np)
+{
+	char *list, *item, *dash;
+	const char *errstr;
+	int *nthreads = NULL;
+	size_t n = 0;
+	int lo, hi;
+
+	list = strdup(arg);
+	if (list == NULL)
+		err(1, "nthreads");
+
+	while ((item = strsep(&list, ",")) != NULL) {
+		dash = strchr(item, '-');
+		if (dash != NULL)
+			*dash++ = '\0';
+
+		lo = strtonum(item, 1, max, &errstr);
+		if (errstr != NULL)
+			errx(1, "nthreads %s: %s", item, errstr);
+		hi = lo;
+		if (dash != NULL) {
+			hi = strtonum(dash, lo, max, &errstr);
+			if (errstr != NULL)
+				errx(1, "nthreads %s: %s", dash, errstr);
+		}
+
+		nthreads = reallocarray(nthreads, n + (hi - lo) + 1,
+		    sizeof(*nthreads));
+		if (nthreads == NULL)
+			err(1, "nthreads");
+		while (lo <= hi)
+			nthreads[n++] = lo++;
+	}
+
+	*np = n;
+	return (nthreads);
+}
+
+static const struct work *
+work_lookup(const struct lock *lk, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < lk->nworks; i++) {
+		const struct work *w = &lk->works[i];
+		if (strcmp(w->name, name) == 0)
+			return (w);
+	}
+
+	errx(1, "%s work not found", name);
+}
 
 int
 main(int argc, char *argv[])
 {
-	struct state s;
-	struct tstate *tsp;
-
-	int nthreads;
-	uint64_t loops = LOOPS;
-	int i;
-	struct timespec tick, tock, diff;
-	struct rusage ru;
+	struct opts o = { .loops = LOOPS };
+	int *nthreads = NULL;
+	size_t nnthreads = 1;
+	const struct lock **lks = NULL;
+	size_t nlks = 0;
+	char **works = NULL;
+	size_t nworks = 0;
+	struct point *points, *pt;
+	size_t npoints, nnoisy, i, j, k, l;
+	unsigned int reps = 0, warmups = 0;
 
 	int ch;
 	const char *errstr;
-	int error;
 	const char *workname = "inc";
-	const struct work *w = NULL;
-	uint64_t v;
+	const char *lockname = NULL;
+	char *list, *name;
+	int perf = 0;
+	const char *events = NULL;
+	const char *tracefile = NULL;
+	const char *pingmode = NULL;
+	const char *nthreadlist = NULL;
+	const char *cpulist = NULL;
+	int maxthreads = MAXTHREADS;
+	int lflag = 0;
 
 #ifdef TESTNAME
 	setprogname(testname = STR(TESTNAME));
@@ -303,21 +1577,106 @@ main(int argc, char *argv[])
 	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
 	if (ncpus == -1)
 		err(1, "sysconf(_SC_NPROCESSORS_ONLN)");
+	o.navail = ncpus;
 
-	nthreads = ncpus;
-
-	while ((ch = getopt(argc, argv, "l:n:w:x:")) != -1) {
+	while ((ch = getopt(argc, argv,
+	    "C:c:D:e:HhI:i:L:l:M:N:n:Pp:R:r:S:s:T:t:W:w:x:")) != -1) {
 		switch (ch) {
+		case 'C':
+			if (churn_config(optarg) == -1)
+				exit(1);
+			break;
+		case 'c':
+			cpulist = optarg;
+			break;
+		case 'D':
+			if (delay_config(optarg) == -1)
+				exit(1);
+			o.delay = 1;
+			break;
+		case 'e':
+			events = optarg;
+			perf = 1;
+			break;
+		case 'H':
+			o.flags |= TS_TIMING;
+			break;
+		case 'h':
+			o.flags |= TS_HANDOFF;
+			break;
+		case 'I':
+			o.intr = strtonum(optarg, 0, 1000000, &errstr);
+			if (errstr != NULL)
+				errx(1, "interrupt period: %s", errstr);
+			o.flags |= TS_INTR;
+			break;
+		case 'i':
+			o.interval = strtonum(optarg, 1, 60000, &errstr);
+			if (errstr != NULL)
+				errx(1, "interval: %s", errstr);
+			break;
+		case 'L':
+			lockname = optarg;
+			break;
+		case 'N':
+			if (noise_config(optarg) == -1)
+				exit(1);
+			o.noise = 1;
+			break;
 		case 'n':
-			nthreads = strtonum(optarg, 1, ncpus, &errstr);
+			nthreadlist = optarg;
+			break;
+		case 'P':
+			perf = 1;
+			break;
+		case 'p':
+			o.placement = optarg;
+			break;
+		case 'R':
+			warmups = strtonum(optarg, 0, 1000, &errstr);
+			if (errstr != NULL)
+				errx(1, "warmups: %s", errstr);
+			break;
+		case 'r':
+			reps = strtonum(optarg, 1, 1000, &errstr);
 			if (errstr != NULL)
-				errx(1, "nthreads: %s", errstr);
+				errx(1, "reps: %s", errstr);
+			break;
+		case 'S':
+#ifdef MTX_SIM
+			if (sim_config(optarg) == -1)
+				exit(1);
+#else
+			errx(1, "-S needs the tests built with SIM=1");
+#endif
+			break;
+		case 's':
+			if (spin_config(optarg) == -1)
+				exit(1);
+			break;
+		case 'T':
+			tracefile = optarg;
+			break;
+		case 't':
+			o.seconds = strtonum(optarg, 1, 86400, &errstr);
+			if (errstr != NULL)
+				errx(1, "seconds: %s", errstr);
 			break;
 		case 'l':
-			loops = strtonum(optarg, 1, UINT64_MAX / ncpus,
+			/* every thread's loops still have to add up */
+			o.loops = strtonum(optarg, 1, LLONG_MAX / MAXTHREADS,
 			    &errstr);
 			if (errstr != NULL)
 				errx(1, "loops: %s", errstr);
+			lflag = 1;
+			break;
+		case 'M':
+			pingmode = optarg;
+			break;
+		case 'W':
+			o.warmup = strtonum(optarg, 1, LLONG_MAX, &errstr);
+			if (errstr != NULL)
+				errx(1, "warmup: %s", errstr);
 			break;
 		case 'w':
 			workname = optarg;
@@ -333,74 +1692,183 @@ main(int argc, char *argv[])
 		}
 	}
 
-	s.bar = 1;
-	mtx_init(&s.mtx);
-	s.loops = loops;
-	s.nthreads = nthreads;
-	s.v = s.pv = 0;
+#ifdef MTX_SIM
+	if (o.seconds > 0 || o.interval > 0 || perf || pingmode != NULL ||
+	    o.placement != NULL || cpulist != NULL || (o.flags & TS_INTR) ||
+	    o.noise)
+		errx(1, "-c, -e, -I, -i, -M, -N, -P, -p, and -t can't be "
+		    "simulated");
+
+	/* virtual cpus can only stall */
+	if (o.delay && delay_conf.d_kind != DELAY_STALL)
+		errx(1, "only -D stall can be simulated");
+	if (churn_conf.c_fresh)
+		errx(1, "-C fresh can't be simulated");
+
+	/* simulated cpus are cheap */
+	maxthreads = SIM_MAXCPUS;
+
+	/* the time a run takes comes from the virtual clocks */
+	cycles_calibrate();
+
+	/* each virtual cpu runs on this thread */
+	sim_tls((void **)&trace_ring);
+	sim_tls((void **)&cpu_info_self);
+#ifdef LOCKSTAT
+	sim_tls((void **)&lockstat_thread);
+#endif
+#endif
 
-	for (i = 0; i < nitems(workers); i++) {
-		const struct work *nw = &workers[i];
-		if (strcmp(nw->name, workname) == 0) {
-			w = nw;
-			break;
+	/* turn the spin budgets into CPU_BUSY_CYCLEs on this cpu */
+	spin_calibrate();
+
+	if (lockname != NULL) {
+		list = strdup(lockname);
+		if (list == NULL)
+			err(1, "lock list");
+		while ((name = strsep(&list, ",")) != NULL) {
+			lks = reallocarray(lks, nlks + 1, sizeof(*lks));
+			if (lks == NULL)
+				err(1, "locks");
+			lks[nlks++] = lock_lookup(name);
 		}
+	} else {
+		/* every lock in the binary */
+		lks = reallocarray(NULL, nlocks, sizeof(*lks));
+		if (lks == NULL)
+			err(1, "locks");
+		for (nlks = 0; nlks < nlocks; nlks++)
+			lks[nlks] = locks[nlks];
 	}
 
-	if (w == NULL)
-		errx(1, "%s work not found", workname);
+	if (pingmode != NULL) {
+		if (ncpus < 2)
+			errx(1, "pingpong needs at least 2 cpus");
+		/* bouncing the line doesn't involve the lock */
+		if (strcmp(pingmode, "line") == 0)
+			nlks = 1;
+		for (i = 0; i < nlks; i++) {
+			pingpong(lks[i], pingmode, ncpus,
+			    lflag ? o.loops : 10000);
+		}
+		return (0);
+	}
 
-	s.w = w;
+	if (cpulist != NULL) {
+		o.navail = cpu_restrict(cpulist);
+		if (o.navail == -1)
+			exit(1);
+	}
+	if (o.placement != NULL &&
+	    cpu_place(o.placement, &o.place, &o.nplace) == -1)
+		exit(1);
+
+	if (nthreadlist != NULL)
+		nthreads = parse_nthreads(nthreadlist, maxthreads, &nnthreads);
+	else {
+		nthreads = malloc(sizeof(*nthreads));
+		if (nthreads == NULL)
+			err(1, "nthreads");
+		nthreads[0] = o.navail;
+	}
 
-	warnx("starting %d threads for %llu loops", nthreads, loops);
+	list = strdup(workname);
+	if (list == NULL)
+		err(1, "work list");
+	while ((name = strsep(&list, ",")) != NULL) {
+		works = reallocarray(works, nworks + 1, sizeof(*works));
+		if (works == NULL)
+			err(1, "works");
+		works[nworks++] = name;
+	}
 
-	tsp = calloc(nthreads, sizeof(*tsp));
-	if (tsp == NULL)
-		err(1, "threads calloc");
+	if (o.seconds > 0) {
+		if (lflag)
+			errx(1, "-l and -t can't be used together");
 
-	for (i = 0; i < nthreads; i++) {
-		struct tstate *ts = &tsp[i];
+		/* run until we're told to stop */
+		o.loops = UINT64_MAX;
+		if (o.interval == 0)
+			o.interval = 100;
+	}
 
-		ts->id = i;
-		ts->state = &s;
+	/* -N runs everything with and without the noise */
+	nnoisy = o.noise ? 2 : 1;
+
+	npoints = nlks * nworks * nnthreads;
+	if (npoints > 1 || reps > 0 || warmups > 0) {
+		if (tracefile != NULL)
+			errx(1, "tracing a sweep is not supported");
+		if (reps == 0) {
+#ifdef MTX_SIM
+			/* every run of a simulation is the same */
+			reps = 1;
+#else
+			reps = 5;
+#endif
+		}
+	}
 
-		error = pthread_create(&ts->pth, NULL, worker, ts);
-		if (error != 0)
-			errc(1, error, "pthread_create %d", i);
+	if (tracefile != NULL) {
+		/* it would only keep the second run */
+		if (o.noise)
+			errx(1, "tracing with -N is not supported");
+		o.tf = fopen(tracefile, "w");
+		if (o.tf == NULL)
+			err(1, "%s", tracefile);
+		o.flags |= TS_TRACE;
 	}
 
-	if (clock_gettime(CLOCK_MONOTONIC, &tick) == -1)
-		err(1, "tick");
+	if (o.flags & (TS_TIMING | TS_HANDOFF | TS_TRACE | TS_INTR))
+		cycles_calibrate();
+	if (o.flags & TS_INTR)
+		intr_establish(intr_handler);
+	if (o.delay) {
+		if (!delay_conf.d_intr)
+			o.flags |= TS_DELAY;
+		else if (!(o.flags & TS_INTR))
+			errx(1, "-D intr needs -I");
+	}
+	/* the interrupts and counters would miss the new threads */
+	if (churn_conf.c_fresh && (perf || (o.flags & TS_INTR)))
+		errx(1, "-C fresh can't be used with -e, -I, or -P");
+	if (perf) {
+		perf_setup(events);
+		o.flags |= TS_PERF;
+	}
 
-	s.bar = 0;
+	if (reps == 0) {
+		for (l = 0; l < nnoisy; l++) {
+			run(&o, lks[0], work_lookup(lks[0], works[0]),
+			    nthreads[0], l, NULL);
+		}
 
-	for (i = 0; i < nthreads; i++) {
-		struct tstate *ts = &tsp[i];
-		void *v;
+		if (o.tf != NULL && fclose(o.tf) == EOF)
+			err(1, "%s", tracefile);
 
-		error = pthread_join(ts->pth, &v);
-		if (error != 0)
-			errc(1, error, "pthread_join %d", i);
-		if (v != NULL)
-			errx(1, "pthread_join %i unexpected value %p", i, v);
+		return (0);
 	}
-	if (clock_gettime(CLOCK_MONOTONIC, &tock) == -1)
-		err(1, "tock");
-
-	if (getrusage(RUSAGE_SELF, &ru) == -1)
-		err(1, "getrusage self");
 
-	w->check(&s);
-
-	timespecsub(&tock, &tick, &diff);
+	npoints *= nnoisy;
+	points = reallocarray(NULL, npoints, sizeof(*points));
+	if (points == NULL)
+		err(1, "points");
+	pt = points;
+	for (i = 0; i < nlks; i++) {
+		for (j = 0; j < nworks; j++) {
+			for (k = 0; k < nnthreads; k++) {
+				for (l = 0; l < nnoisy; l++) {
+					pt->lk = lks[i];
+					pt->w = work_lookup(lks[i], works[j]);
+					pt->nthreads = nthreads[k];
+					pt->noisy = l;
+					pt++;
+				}
+			}
+		}
+	}
 
-	printf("{");
-	printf("\"lock\":\"%s\",", testname);
-	printf("\"work\":\"%s\",", workname);
-	printf("\"loops\":%llu,", loops);
-	printf("\"nthreads\":%d,", nthreads);
-	printf("\"time\":%lld.%03ld", diff.tv_sec, diff.tv_nsec / 1000000);
-	printf("}\n");
+	sweep(&o, points, npoints, reps, warmups);
 
 	return (0);
 }
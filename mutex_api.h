@@ -1,4 +1,19 @@
 
+/*
+ * the test in locks/ has every mutex implementation in it, and
+ * builds each with MTX_NS set to a prefix for its external names.
+ */
+#ifdef MTX_NS
+#define MTX_NS_CAT(_ns, _n)	_ns ## _ ## _n
+#define MTX_NS_NAME(_ns, _n)	MTX_NS_CAT(_ns, _n)
+
+#define mtx_init		MTX_NS_NAME(MTX_NS, mtx_init)
+#define mtx_enter_try		MTX_NS_NAME(MTX_NS, mtx_enter_try)
+#define mtx_enter		MTX_NS_NAME(MTX_NS, mtx_enter)
+#define mtx_leave		MTX_NS_NAME(MTX_NS, mtx_leave)
+#define _kernel_lock_init	MTX_NS_NAME(MTX_NS, _kernel_lock_init)
+#endif
+
 void	mtx_init(struct mutex *);
 int	mtx_enter_try(struct mutex *);
 void	mtx_enter(struct mutex *);
@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <err.h>
+#include <errno.h>
+
+#include <pthread.h>
+
+#include "atomic.h"
+#include "noise.h"
+#include "cpu.h"
+#include "rng.h"
+
+#define nitems(_a) (sizeof((_a)) / sizeof((_a)[0]))
+
+#define NOISE_LINE		64
+#define NOISE_CHUNK		(1024 * 1024)	/* bytes between checks */
+#define NOISE_MAXTHREADS	1024
+
+struct noise noise_conf;
+
+static const char *noise_names[] = NOISE_NAMES;
+static const size_t noise_defmb[] = {
+	[NOISE_STREAM] =	256,
+	[NOISE_LLC] =		64,
+};
+
+struct noise_thread {
+	unsigned int		 id;
+	int			 cpu;		/* -1 if not bound */
+	pthread_t		 pth;
+	uint64_t		 bytes;		/* touched */
+	struct timespec		 runtime;	/* cpu time after the barrier */
+};
+
+static struct noise_thread *noise_threads;
+static pthread_barrier_t noise_ready;
+static int noise_stopping;
+static struct timespec noise_tick, noise_tock;
+
+/*
+ * parse kind[=mb][,n=nthreads][,duty=percent][,on=placement], eg,
+ * "llc=32,n=4,on=4-7". on= takes a policy or a cpu list like -p
+ * does, so it has to come last.
+ */
+
+int
+noise_config(const char *spec)
+{
+	char *list, *item, *val;
+	const char *errstr;
+	size_t i;
+
+	list = strdup(spec);
+	if (list == NULL)
+		err(1, "noise config");
+
+	noise_conf.n_nthreads = 1;
+	noise_conf.n_duty = 100;
+
+	item = strsep(&list, ",");
+	val = strchr(item, '=');
+	if (val != NULL)
+		*val++ = '\0';
+
+	for (i = 0; i < nitems(noise_names); i++) {
+		if (strcmp(noise_names[i], item) == 0)
+			break;
+	}
+	if (i == nitems(noise_names)) {
+		warnx("noise %s: unknown kind", item);
+		return (-1);
+	}
+	noise_conf.n_kind = i;
+
+	noise_conf.n_mb = noise_defmb[i];
+	if (val != NULL) {
+		noise_conf.n_mb = strtonum(val, 1, 65536, &errstr);
+		if (errstr != NULL) {
+			warnx("noise %s %s: %s", item, val, errstr);
+			return (-1);
+		}
+	}
+
+	while ((item = strsep(&list, ",")) != NULL) {
+		if (strncmp(item, "on=", 3) == 0) {
+			/* put the rest of the cpu list back together */
+			if (list != NULL)
+				list[-1] = ',';
+			noise_conf.n_placement = item + 3;
+			break;
+		}
+
+		val = strchr(item, '=');
+		if (val == NULL) {
+			warnx("noise %s: expected name=value", item);
+			return (-1);
+		}
+		*val++ = '\0';
+
+		if (strcmp(item, "n") == 0) {
+			noise_conf.n_nthreads = strtonum(val, 1,
+			    NOISE_MAXTHREADS, &errstr);
+		} else if (strcmp(item, "duty") == 0)
+			noise_conf.n_duty = strtonum(val, 1, 100, &errstr);
+		else {
+			warnx("noise %s: expected n, duty, or on", item);
+			return (-1);
+		}
+		if (errstr != NULL) {
+			warnx("noise %s %s: %s", item, val, errstr);
+			return (-1);
+		}
+	}
+
+	if (noise_conf.n_placement != NULL &&
+	    cpu_place(noise_conf.n_placement, &noise_conf.n_place,
+	    &noise_conf.n_nplace) == -1)
+		return (-1);
+
+	return (0);
+}
+
+static void *
+noise_thread(void *arg)
+{
+	struct noise_thread *nt = arg;
+	size_t len = noise_conf.n_mb << 20;
+	size_t nlines = len / NOISE_LINE;
+	size_t off = 0, i;
+	uint64_t rng = RNG_SEED(nt->id);
+	uint64_t *buf, *w;
+	struct timespec tick, tock, diff, start;
+	uint64_t ns;
+
+	if (nt->cpu != -1 && cpu_bind(pthread_self(), nt->cpu) == -1)
+		err(1, "noise %u bind to cpu %d", nt->id, nt->cpu);
+
+	/* fault the buffer in on this thread's cpu before the run */
+	buf = malloc(len);
+	if (buf == NULL)
+		err(1, "noise %u buffer", nt->id);
+	memset(buf, 0, len);
+
+	pthread_barrier_wait(&noise_ready);
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start) == -1)
+		err(1, "noise %u start", nt->id);
+
+	while (!READ_ONCE(noise_stopping)) {
+		if (noise_conf.n_duty < 100 &&
+		    clock_gettime(CLOCK_MONOTONIC, &tick) == -1)
+			err(1, "noise tick");
+
+		switch (noise_conf.n_kind) {
+		case NOISE_STREAM:
+			w = buf + off / sizeof(*buf);
+			for (i = 0; i < NOISE_CHUNK / sizeof(*buf); i++)
+				w[i]++;
+			off += NOISE_CHUNK;
+			if (off + NOISE_CHUNK > len)
+				off = 0;
+			break;
+		case NOISE_LLC:
+			for (i = 0; i < NOISE_CHUNK / NOISE_LINE; i++) {
+				w = buf + (rng_next(&rng) % nlines) *
+				    (NOISE_LINE / sizeof(*buf));
+				(*w)++;
+			}
+			break;
+		}
+		/* the buffer is never read, so make the writes happen */
+		__asm volatile("" : : "r" (buf) : "memory");
+		nt->bytes += NOISE_CHUNK;
+
+		if (noise_conf.n_duty < 100) {
+			if (clock_gettime(CLOCK_MONOTONIC, &tock) == -1)
+				err(1, "noise tock");
+			timespecsub(&tock, &tick, &diff);
+			ns = diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+			ns = ns * (100 - noise_conf.n_duty) / noise_conf.n_duty;
+			diff.tv_sec = ns / 1000000000ULL;
+			diff.tv_nsec = ns % 1000000000ULL;
+			nanosleep(&diff, NULL);
+		}
+	}
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tock) == -1)
+		err(1, "noise %u stop", nt->id);
+	timespecsub(&tock, &start, &nt->runtime);
+
+	free(buf);
+
+	return (NULL);
+}
+
+/*
+ * start the noise threads, and wait for them to fault their buffers
+ * in so that doesn't get counted against the run.
+ */
+
+void
+noise_start(void)
+{
+	struct noise_thread *nt;
+	unsigned int i;
+	int error;
+
+	free(noise_threads);
+	noise_threads = calloc(noise_conf.n_nthreads, sizeof(*noise_threads));
+	if (noise_threads == NULL)
+		err(1, "noise threads");
+
+	error = pthread_barrier_init(&noise_ready, NULL,
+	    noise_conf.n_nthreads + 1);
+	if (error != 0)
+		errc(1, error, "noise barrier");
+
+	WRITE_ONCE(noise_stopping, 0);
+	for (i = 0; i < noise_conf.n_nthreads; i++) {
+		nt = &noise_threads[i];
+		nt->id = i;
+		nt->cpu = noise_conf.n_nplace > 0 ?
+		    noise_conf.n_place[i % noise_conf.n_nplace] : -1;
+
+		error = pthread_create(&nt->pth, NULL, noise_thread, nt);
+		if (error != 0)
+			errc(1, error, "pthread_create noise %u", i);
+	}
+
+	pthread_barrier_wait(&noise_ready);
+
+	if (clock_gettime(CLOCK_MONOTONIC, &noise_tick) == -1)
+		err(1, "noise start");
+}
+
+void
+noise_stop(void)
+{
+	unsigned int i;
+	int error;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &noise_tock) == -1)
+		err(1, "noise stop");
+
+	WRITE_ONCE(noise_stopping, 1);
+	for (i = 0; i < noise_conf.n_nthreads; i++) {
+		error = pthread_join(noise_threads[i].pth, NULL);
+		if (error != 0)
+			errc(1, error, "pthread_join noise %u", i);
+	}
+
+	pthread_barrier_destroy(&noise_ready);
+}
+
+/*
+ * how much cpu time the noise threads used between noise_start and
+ * noise_stop, for taking out of the process's rusage.
+ */
+
+void
+noise_runtime(struct timespec *runtime)
+{
+	unsigned int i;
+
+	runtime->tv_sec = 0;
+	runtime->tv_nsec = 0;
+	for (i = 0; i < noise_conf.n_nthreads; i++)
+		timespecadd(runtime, &noise_threads[i].runtime, runtime);
+}
+
+/*
+ * print the configuration, and with stats, how hard the noise threads
+ * managed to hit memory between noise_start and noise_stop.
+ */
+
+void
+noise_print(int stats)
+{
+	struct timespec diff;
+	uint64_t bytes = 0;
+	double secs;
+	unsigned int i;
+
+	printf("\"noise\":{");
+	printf("\"kind\":\"%s\",", noise_names[noise_conf.n_kind]);
+	printf("\"mb\":%zu,", noise_conf.n_mb);
+	printf("\"nthreads\":%u,", noise_conf.n_nthreads);
+	printf("\"duty\":%u", noise_conf.n_duty);
+	if (noise_conf.n_placement != NULL) {
+		printf(",\"cpus\":[");
+		for (i = 0; i < noise_conf.n_nthreads; i++) {
+			printf("%s%d", i ? "," : "",
+			    noise_conf.n_place[i % noise_conf.n_nplace]);
+		}
+		printf("]");
+	}
+	if (stats) {
+		for (i = 0; i < noise_conf.n_nthreads; i++)
+			bytes += noise_threads[i].bytes;
+		timespecsub(&noise_tock, &noise_tick, &diff);
+		secs = diff.tv_sec + diff.tv_nsec / 1000000000.0;
+		printf(",\"mb_per_sec\":%.0f",
+		    secs > 0.0 ? bytes / secs / (1024 * 1024) : 0.0);
+	}
+	printf("}");
+}
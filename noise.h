@@ -0,0 +1,49 @@
+/*
+ * noisy neighbours.
+ *
+ * -N starts threads next to the workers that don't touch the lock,
+ * but get in the way of the cachelines it and the mutex
+ * implementations use:
+ *
+ *  - stream reads and writes its way through a buffer from start to
+ *    end, over and over, which uses up memory bandwidth.
+ *  - llc writes to cachelines picked at random from a buffer bigger
+ *    than the last level cache, which keeps evicting everything
+ *    else from it.
+ *
+ * each noise thread has a buffer of its own. they can be told how
+ * much of the time to run for, and which cpus to run on.
+ */
+
+#ifndef _NOISE_H_
+#define _NOISE_H_
+
+#include <stddef.h>
+#include <time.h>
+
+enum noise_kind {
+	NOISE_STREAM,
+	NOISE_LLC,
+};
+
+#define NOISE_NAMES { "stream", "llc" }
+
+struct noise {
+	enum noise_kind		 n_kind;
+	size_t			 n_mb;		/* buffer per thread */
+	unsigned int		 n_nthreads;
+	unsigned int		 n_duty;	/* percent of the time */
+	const char		*n_placement;	/* -p style, or NULL */
+	int			*n_place;
+	size_t			 n_nplace;
+};
+
+extern struct noise noise_conf;
+
+int	noise_config(const char *);
+void	noise_start(void);
+void	noise_stop(void);
+void	noise_runtime(struct timespec *);
+void	noise_print(int);
+
+#endif /* _NOISE_H_ */
@@ -0,0 +1 @@
+../parking-mcs/mutex.c
\ No newline at end of file
@@ -0,0 +1 @@
+../parking-mcs/mutex.h
\ No newline at end of file
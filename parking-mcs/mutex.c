@@ -33,6 +33,10 @@
 
 #include <mutex.h>
 #include "../atomic.h"
+#include "../trace.h"
+#include "../lockstat.h"
+#include "../intr.h"
+#include "../spin.h"
 
 #include <machine/spinlock.h>
 #include <sys/queue.h>
@@ -45,12 +49,16 @@
  */
 #define ISSET(_w, _m) ((_w) & (_m))
 
-#define intr_disable() (0)
-#define intr_restore(m) do { } while (0)
+#ifdef MTX_PERCPU
+#include "../cpuinfo.h"
 
+#define mtx_self() ((unsigned long)curcpu())
+#else
 struct cpu_info;
 
 #define curcpu() ((struct cpu_info *)1)
+#define mtx_self() ((unsigned long)pthread_self())
+#endif
 
 /*
  * pretend this is the top of src/sys/kern/kern_lock.c
@@ -81,9 +89,16 @@ struct mcs_node {
 };
 
 struct mcs_lock {
-	struct mcs_lock		*tail;
+	struct mcs_node		*tail;
 };
 
+#ifdef MTX_PERCPU
+_Static_assert(sizeof(struct waiter) <= CPU_NODESIZE,
+    "struct waiter doesn't fit in a cpu_info node");
+_Static_assert(sizeof(struct mcs_node) <= CPU_NODESIZE,
+    "struct mcs_node doesn't fit in a cpu_info node");
+#endif
+
 static void
 mcs_init(struct mcs_lock *l)
 {
@@ -108,6 +123,7 @@ mcs_enter(struct mcs_lock *l, struct mcs_node *n)
 
 	do {
 		CPU_BUSY_CYCLE();
+		LOCKSTAT_INC(LS_BUCKET_SPINS);
 	} while (n->wait);
 
 	membar_enter();
@@ -176,6 +192,8 @@ mtx_enter_park(struct mtx_park *p, struct mcs_node *n)
 
 	m = intr_disable();
 	mcs_enter(&p->lock, n);
+	LOCKSTAT_INC(LS_BUCKET);
+	trace(TRACE_BUCKET, p);
 
 	return (m);
 }
@@ -196,7 +214,7 @@ mtx_init(struct mutex *mtx)
 int
 mtx_enter_try(struct mutex *mtx)
 {
-	unsigned long self = (unsigned long)pthread_self();
+	unsigned long self = mtx_self();
 
 	if (atomic_cas_ulong(&mtx->mtx_owner, 0, self) == 0) {
 		membar_enter_after_atomic();
@@ -212,10 +230,15 @@ void
 mtx_enter(struct mutex *mtx)
 {
 	struct mtx_park *p;
-	struct waiter w, *n;
-	unsigned long self = (unsigned long)pthread_self();
+#ifdef MTX_PERCPU
+	struct waiter *w;
+	struct mcs_node *mn;
+#else
+	struct waiter _w, *w = &_w;
+	struct mcs_node _mn, *mn = &_mn;
+#endif
+	unsigned long self = mtx_self();
 	unsigned long owner;
-	struct mcs_node mn;
 	unsigned long m;
 #ifndef NOMEDIUM
 	unsigned int i;
@@ -224,6 +247,7 @@ mtx_enter(struct mutex *mtx)
 	owner = atomic_cas_ulong(&mtx->mtx_owner, 0, self);
 	if (owner == 0) {
 		/* we got the lock first go. this is the fast path */
+		LOCKSTAT_INC(LS_FAST);
 		goto locked;
 	}
 
@@ -236,40 +260,55 @@ mtx_enter(struct mutex *mtx)
 	}
 
 #ifndef NOMEDIUM
-	for (i = 0; i < 40; i++) {
+	for (i = spin_counts[SPIN_MEDIUM]; i > 0; i--) {
 		if (ISSET(owner, 1))
 			break;
 		CPU_BUSY_CYCLE();
+		LOCKSTAT_INC(LS_SPINS);
 		owner = mtx->mtx_owner;
 		if (owner == 0) {
 			owner = atomic_cas_ulong(&mtx->mtx_owner, 0, self);
-			if (owner == 0)
+			if (owner == 0) {
+				LOCKSTAT_INC(LS_SPIN);
 				goto locked;
+			}
 		}
 	}
 #endif
 
-	w.mtx = mtx;
+#ifdef MTX_PERCPU
+	CPU_SPINOUT(curcpu());
+	w = cpu_node_get();
+	mn = cpu_node_get();
+#endif
+	w->mtx = mtx;
 
 	/* take the really slow path */
 	p = mtx_park(mtx);
 
 	/* spinning++ */
-	m = mtx_enter_park(p, &mn);
-	TAILQ_INSERT_TAIL(&p->waiters, &w, entry);
-	mtx_leave_park(p, &mn, m);
+	m = mtx_enter_park(p, mn);
+	TAILQ_INSERT_TAIL(&p->waiters, w, entry);
+	LOCKSTAT_INC(LS_PARK);
+	mtx_leave_park(p, mn, m);
 
 	do {
 		unsigned long o;
+		int woken = 0;
 
 		assert(owner != 0);
 
-		w.wait = 1;
+		w->wait = 1;
 		membar_enter(); /* StoreStore|StoreLoad */
 		o = atomic_cas_ulong(&mtx->mtx_owner, owner, owner | 1);
 		if (o == owner) {
-			while (w.wait)
+			woken = 1;
+			trace(TRACE_PARK, mtx);
+			while (w->wait) {
 				CPU_BUSY_CYCLE();
+				LOCKSTAT_INC(LS_PARK_SPINS);
+			}
+			trace(TRACE_UNPARK, mtx);
 			membar_consumer(); /* don't pre-fetch owner */
 		} else if (o != 0) {
 			owner = o;
@@ -277,12 +316,20 @@ mtx_enter(struct mutex *mtx)
 		}
 
 		owner = atomic_cas_ulong(&mtx->mtx_owner, 0, self | 1);
+		if (woken && owner != 0) {
+			/* someone barged in while we were being woken */
+			LOCKSTAT_INC(LS_STEAL);
+		}
 	} while (owner != 0);
 
-	m = mtx_enter_park(p, &mn);
-	TAILQ_REMOVE(&p->waiters, &w, entry);
-	mtx_leave_park(p, &mn, m);
+	m = mtx_enter_park(p, mn);
+	TAILQ_REMOVE(&p->waiters, w, entry);
+	mtx_leave_park(p, mn, m);
 	/* spinning-- */
+#ifdef MTX_PERCPU
+	cpu_node_put(mn);
+	cpu_node_put(w);
+#endif
 
 locked:
 	membar_enter_after_atomic();
@@ -291,14 +338,18 @@ locked:
 void
 mtx_leave(struct mutex *mtx)
 {
-	unsigned long self = (unsigned long)pthread_self();
+	unsigned long self = mtx_self();
 	unsigned long owner;
 
 	membar_exit_before_atomic();
 	owner = atomic_cas_ulong(&mtx->mtx_owner, self, 0);
 	if (owner != self) {
 		struct mtx_park *p;
-		struct mcs_node mn;
+#ifdef MTX_PERCPU
+		struct mcs_node *mn;
+#else
+		struct mcs_node _mn, *mn = &_mn;
+#endif
 		unsigned long m;
 		struct waiter *w;
 
@@ -310,16 +361,26 @@ mtx_leave(struct mutex *mtx)
 			abort();
 		}
 
+		LOCKSTAT_INC(LS_LEAVE_SLOW);
+
+#ifdef MTX_PERCPU
+		mn = cpu_node_get();
+#endif
 		p = mtx_park(mtx);
-		m = mtx_enter_park(p, &mn);
+		m = mtx_enter_park(p, mn);
 		mtx->mtx_owner = 0;
 		membar_producer(); /* StoreStore */
 		TAILQ_FOREACH(w, &p->waiters, entry) {
 			if (w->mtx == mtx) {
+				LOCKSTAT_INC(LS_HANDOFF);
+				trace(TRACE_WAKE, mtx);
 				w->wait = 0;
 				break;
 			}
 		}
-		mtx_leave_park(p, &mn, m);
+		mtx_leave_park(p, mn, m);
+#ifdef MTX_PERCPU
+		cpu_node_put(mn);
+#endif
 	}
 }
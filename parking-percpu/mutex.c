@@ -0,0 +1 @@
+../parking/mutex.c
\ No newline at end of file
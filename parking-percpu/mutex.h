@@ -0,0 +1 @@
+../parking/mutex.h
\ No newline at end of file
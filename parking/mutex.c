@@ -33,6 +33,10 @@
 
 #include <mutex.h>
 #include "../atomic.h"
+#include "../trace.h"
+#include "../lockstat.h"
+#include "../intr.h"
+#include "../spin.h"
 
 #include <machine/spinlock.h>
 #include <sys/queue.h>
@@ -45,12 +49,16 @@
  */
 #define ISSET(_w, _m) ((_w) & (_m))
 
-#define intr_disable() (0)
-#define intr_restore(m) do { } while (0)
+#ifdef MTX_PERCPU
+#include "../cpuinfo.h"
 
+#define mtx_self() ((unsigned long)curcpu())
+#else
 struct cpu_info;
 
 #define curcpu() ((struct cpu_info *)1)
+#define mtx_self() ((unsigned long)pthread_self())
+#endif
 
 /*
  * pretend this is the top of src/sys/kern/kern_lock.c
@@ -74,6 +82,11 @@ struct waiter {
 
 TAILQ_HEAD(mtx_waitlist, waiter);
 
+#ifdef MTX_PERCPU
+_Static_assert(sizeof(struct waiter) <= CPU_NODESIZE,
+    "struct waiter doesn't fit in a cpu_info node");
+#endif
+
 struct mtx_park {
 	struct cpu_info		*lock;
 	struct mtx_waitlist	 waiters;
@@ -116,9 +129,13 @@ mtx_enter_park(struct mtx_park *p)
 	unsigned long m;
 
 	m = intr_disable();
-	while (atomic_cas_ptr(&p->lock, NULL, ci) != 0)
+	while (atomic_cas_ptr(&p->lock, NULL, ci) != 0) {
 		CPU_BUSY_CYCLE();
+		LOCKSTAT_INC(LS_BUCKET_SPINS);
+	}
 	membar_enter_after_atomic();
+	LOCKSTAT_INC(LS_BUCKET);
+	trace(TRACE_BUCKET, p);
 
 	return (m);
 }
@@ -127,7 +144,7 @@ static void
 mtx_leave_park(struct mtx_park *p, unsigned long m)
 {
 	membar_exit();
-	p->lock = NULL;
+	WRITE_ONCE(p->lock, NULL);
 	intr_restore(m);
 }
 
@@ -140,7 +157,7 @@ mtx_init(struct mutex *mtx)
 int
 mtx_enter_try(struct mutex *mtx)
 {
-	unsigned long self = (unsigned long)pthread_self();
+	unsigned long self = mtx_self();
 
 	if (atomic_cas_ulong(&mtx->mtx_owner, 0, self) == 0) {
 		membar_enter_after_atomic();
@@ -154,8 +171,12 @@ void
 mtx_enter(struct mutex *mtx)
 {
 	struct mtx_park *p;
-	struct waiter w, *n;
-	unsigned long self = (unsigned long)pthread_self();
+#ifdef MTX_PERCPU
+	struct waiter *w;
+#else
+	struct waiter _w, *w = &_w;
+#endif
+	unsigned long self = mtx_self();
 	unsigned long owner;
 	unsigned long m;
 #ifndef NOMEDIUM
@@ -165,6 +186,7 @@ mtx_enter(struct mutex *mtx)
 	owner = atomic_cas_ulong(&mtx->mtx_owner, 0, self);
 	if (owner == 0) {
 		/* we got the lock first go. this is the fast path */
+		LOCKSTAT_INC(LS_FAST);
 		goto locked;
 	}
 
@@ -176,40 +198,54 @@ mtx_enter(struct mutex *mtx)
 	}
 
 #ifndef NOMEDIUM
-	for (i = 0; i < 40; i++) {
+	for (i = spin_counts[SPIN_MEDIUM]; i > 0; i--) {
 		if (ISSET(owner, 1))
 			break;
 		CPU_BUSY_CYCLE();
-		owner = mtx->mtx_owner;
+		LOCKSTAT_INC(LS_SPINS);
+		owner = READ_ONCE(mtx->mtx_owner);
 		if (owner == 0) {
 			owner = atomic_cas_ulong(&mtx->mtx_owner, 0, self);
-			if (owner == 0)
+			if (owner == 0) {
+				LOCKSTAT_INC(LS_SPIN);
 				goto locked;
+			}
 		}
 	}
 #endif
 
-	w.mtx = mtx;
+#ifdef MTX_PERCPU
+	CPU_SPINOUT(curcpu());
+	w = cpu_node_get();
+#endif
+	w->mtx = mtx;
 
 	/* take the really slow path */
 	p = mtx_park(mtx);
 
 	/* spinning++ */
 	m = mtx_enter_park(p);
-	TAILQ_INSERT_TAIL(&p->waiters, &w, entry);
+	TAILQ_INSERT_TAIL(&p->waiters, w, entry);
+	LOCKSTAT_INC(LS_PARK);
 	mtx_leave_park(p, m);
 
 	do {
 		unsigned long o;
+		int woken = 0;
 
 		assert(owner != 0);
 
-		w.wait = 1;
+		WRITE_ONCE(w->wait, 1);
 		membar_enter(); /* StoreStore|StoreLoad */
 		o = atomic_cas_ulong(&mtx->mtx_owner, owner, owner | 1);
 		if (o == owner) {
-			while (w.wait)
+			woken = 1;
+			trace(TRACE_PARK, mtx);
+			while (READ_ONCE(w->wait)) {
 				CPU_BUSY_CYCLE();
+				LOCKSTAT_INC(LS_PARK_SPINS);
+			}
+			trace(TRACE_UNPARK, mtx);
 			membar_consumer(); /* don't pre-fetch owner */
 		} else if (o != 0) {
 			owner = o;
@@ -217,12 +253,19 @@ mtx_enter(struct mutex *mtx)
 		}
 
 		owner = atomic_cas_ulong(&mtx->mtx_owner, 0, self | 1);
+		if (woken && owner != 0) {
+			/* someone barged in while we were being woken */
+			LOCKSTAT_INC(LS_STEAL);
+		}
 	} while (owner != 0);
 
 	m = mtx_enter_park(p);
-	TAILQ_REMOVE(&p->waiters, &w, entry);
+	TAILQ_REMOVE(&p->waiters, w, entry);
 	mtx_leave_park(p, m);
 	/* spinning-- */
+#ifdef MTX_PERCPU
+	cpu_node_put(w);
+#endif
 
 locked:
 	membar_enter_after_atomic();
@@ -231,7 +274,7 @@ locked:
 void
 mtx_leave(struct mutex *mtx)
 {
-	unsigned long self = (unsigned long)pthread_self();
+	unsigned long self = mtx_self();
 	unsigned long owner;
 
 	membar_exit_before_atomic();
@@ -248,13 +291,17 @@ mtx_leave(struct mutex *mtx)
 			abort();
 		}
 
+		LOCKSTAT_INC(LS_LEAVE_SLOW);
+
 		p = mtx_park(mtx);
 		m = mtx_enter_park(p);
-		mtx->mtx_owner = 0;
+		WRITE_ONCE(mtx->mtx_owner, 0);
 		membar_producer(); /* StoreStore */
 		TAILQ_FOREACH(w, &p->waiters, entry) {
 			if (w->mtx == mtx) {
-				w->wait = 0;
+				LOCKSTAT_INC(LS_HANDOFF);
+				trace(TRACE_WAKE, mtx);
+				WRITE_ONCE(w->wait, 0);
 				break;
 			}
 		}
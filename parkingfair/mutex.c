@@ -40,6 +40,10 @@
 
 #include <mutex.h>
 #include "../atomic.h"
+#include "../trace.h"
+#include "../lockstat.h"
+#include "../intr.h"
+#include "../spin.h"
 
 #include <machine/spinlock.h>
 #include <sys/queue.h>
@@ -52,9 +56,6 @@
  */
 #define ISSET(_w, _m) ((_w) & (_m))
 
-#define intr_disable() (0)
-#define intr_restore(m) do { } while (0)
-
 struct cpu_info;
 
 #define curcpu() ((struct cpu_info *)1)
@@ -121,9 +122,13 @@ mtx_enter_park(struct mtx_park *p)
 	unsigned long m;
 
 	m = intr_disable();
-	while (atomic_cas_ptr(&p->lock, NULL, ci) != 0)
+	while (atomic_cas_ptr(&p->lock, NULL, ci) != 0) {
 		CPU_BUSY_CYCLE();
+		LOCKSTAT_INC(LS_BUCKET_SPINS);
+	}
 	membar_enter_after_atomic();
+	LOCKSTAT_INC(LS_BUCKET);
+	trace(TRACE_BUCKET, p);
 
 	return (m);
 }
@@ -168,6 +173,7 @@ mtx_enter(struct mutex *mtx)
 	owner = atomic_cas_ulong(&mtx->mtx_owner, 0, self);
 	if (owner == 0) {
 		/* we got the lock first go. this is the fast path */
+		LOCKSTAT_INC(LS_FAST);
 		goto locked;
 	}
 
@@ -178,15 +184,18 @@ mtx_enter(struct mutex *mtx)
 		abort();
 	}
 
-	for (i = 0; i < 40; i++) {
+	for (i = spin_counts[SPIN_MEDIUM]; i > 0; i--) {
 		if (ISSET(owner, 1))
 			break;
 		CPU_BUSY_CYCLE();
+		LOCKSTAT_INC(LS_SPINS);
 		owner = mtx->mtx_owner;
 		if (owner == 0) {
 			owner = atomic_cas_ulong(&mtx->mtx_owner, 0, self);
-			if (owner == 0)
+			if (owner == 0) {
+				LOCKSTAT_INC(LS_SPIN);
 				goto locked;
+			}
 		}
 	}
 
@@ -199,6 +208,7 @@ mtx_enter(struct mutex *mtx)
 	w.spins = 0;
 	m = mtx_enter_park(p);
 	TAILQ_INSERT_TAIL(&p->waiters, &w, entry);
+	LOCKSTAT_INC(LS_PARK);
 	mtx_leave_park(p, m);
 
 	for (;;) {
@@ -211,14 +221,20 @@ mtx_enter(struct mutex *mtx)
 		if ((o | 1) == (self | 1))
 			break;
 		if (ISSET(o, 1)) {
-			while (w.mtx != NULL)
+			trace(TRACE_PARK, mtx);
+			while (w.mtx != NULL) {
 				CPU_BUSY_CYCLE();
+				LOCKSTAT_INC(LS_PARK_SPINS);
+			}
+			trace(TRACE_UNPARK, mtx);
 			w.spins++;
 		}
 
 		owner = atomic_cas_ulong(&mtx->mtx_owner, 0, self);
 		if (owner == 0) // || (owner & ~1UL) == self)
 			break;
+		if (ISSET(o, 1))
+			LOCKSTAT_INC(LS_STEAL);
 
 		w.mtx = mtx;
 	}
@@ -260,11 +276,15 @@ mtx_leave(struct mutex *mtx)
 			abort();
 		}
 
+		LOCKSTAT_INC(LS_LEAVE_SLOW);
+
 		p = mtx_park(mtx);
 		m = mtx_enter_park(p);
 		TAILQ_FOREACH(w, &p->waiters, entry) {
 			if (w->mtx == mtx) {
 				mtx->mtx_owner = (w->spins > x) ? w->self : 0;
+				LOCKSTAT_INC(LS_HANDOFF);
+				trace(TRACE_WAKE, mtx);
 				w->mtx = NULL;
 				goto leave;
 			}
@@ -33,6 +33,10 @@
 
 #include <mutex.h>
 #include "../atomic.h"
+#include "../trace.h"
+#include "../lockstat.h"
+#include "../intr.h"
+#include "../spin.h"
 
 #include <machine/spinlock.h>
 #include <sys/queue.h>
@@ -45,9 +49,6 @@
  */
 #define ISSET(_w, _m) ((_w) & (_m))
 
-#define intr_disable() (0)
-#define intr_restore(m) do { } while (0)
-
 struct cpu_info;
 
 #define curcpu() ((struct cpu_info *)1)
@@ -119,9 +120,12 @@ mtx_enter_park(struct mtx_park *p)
 	while (atomic_cas_ptr(&p->lock, NULL, ci) != 0) {
 		do {
 			CPU_BUSY_CYCLE();
+			LOCKSTAT_INC(LS_BUCKET_SPINS);
 		} while (p->lock != NULL);
 	}
 	membar_enter_after_atomic();
+	LOCKSTAT_INC(LS_BUCKET);
+	trace(TRACE_BUCKET, p);
 
 	return (m);
 }
@@ -170,6 +174,7 @@ mtx_enter(struct mutex *mtx)
 	owner = atomic_cas_ulong(&mtx->mtx_owner, 0, self);
 	if (owner == 0) {
 		/* we got the lock first go. this is the fast path */
+		LOCKSTAT_INC(LS_FAST);
 		goto locked;
 	}
 
@@ -182,15 +187,18 @@ mtx_enter(struct mutex *mtx)
 	}
 
 #ifndef NOMEDIUM
-	for (i = 0; i < 40; i++) {
+	for (i = spin_counts[SPIN_MEDIUM]; i > 0; i--) {
 		if (ISSET(owner, 1))
 			break;
 		CPU_BUSY_CYCLE();
+		LOCKSTAT_INC(LS_SPINS);
 		owner = mtx->mtx_owner;
 		if (owner == 0) {
 			owner = atomic_cas_ulong(&mtx->mtx_owner, 0, self);
-			if (owner == 0)
+			if (owner == 0) {
+				LOCKSTAT_INC(LS_SPIN);
 				goto locked;
+			}
 		}
 	}
 #endif
@@ -203,10 +211,12 @@ mtx_enter(struct mutex *mtx)
 	/* spinning++ */
 	m = mtx_enter_park(p);
 	TAILQ_INSERT_TAIL(&p->waiters, &w, entry);
+	LOCKSTAT_INC(LS_PARK);
 	mtx_leave_park(p, m);
 
 	do {
 		unsigned long o;
+		int woken = 0;
 
 		assert(owner != 0);
 
@@ -214,8 +224,13 @@ mtx_enter(struct mutex *mtx)
 		membar_enter(); /* StoreStore|StoreLoad */
 		o = atomic_cas_ulong(&mtx->mtx_owner, owner, owner | 1);
 		if (o == owner) {
-			while (w.wait)
+			woken = 1;
+			trace(TRACE_PARK, mtx);
+			while (w.wait) {
 				CPU_BUSY_CYCLE();
+				LOCKSTAT_INC(LS_PARK_SPINS);
+			}
+			trace(TRACE_UNPARK, mtx);
 			membar_consumer(); /* don't pre-fetch owner */
 		} else if (o != 0) {
 			owner = o;
@@ -223,6 +238,10 @@ mtx_enter(struct mutex *mtx)
 		}
 
 		owner = atomic_cas_ulong(&mtx->mtx_owner, 0, self | 1);
+		if (woken && owner != 0) {
+			/* someone barged in while we were being woken */
+			LOCKSTAT_INC(LS_STEAL);
+		}
 	} while (owner != 0);
 
 	m = mtx_enter_park(p);
@@ -255,12 +274,16 @@ mtx_leave(struct mutex *mtx)
 			abort();
 		}
 
+		LOCKSTAT_INC(LS_LEAVE_SLOW);
+
 		p = mtx_park(mtx);
 		m = mtx_enter_park(p);
 		mtx->mtx_owner = 0;
 		membar_producer(); /* StoreStore */
 		TAILQ_FOREACH(w, &p->waiters, entry) {
 			if (w->mtx == mtx) {
+				LOCKSTAT_INC(LS_HANDOFF);
+				trace(TRACE_WAKE, mtx);
 				w->wait = 0;
 				break;
 			}
@@ -0,0 +1,258 @@
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+
+#include "perf.h"
+
+#define PERF_DEFAULT	"cycles,instructions,cache-misses,branch-misses"
+
+static const char *perf_names[PERF_MAXEVENTS];
+static unsigned int perf_n;
+
+#ifdef __linux__
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <unistd.h>
+
+struct perf_event {
+	const char		*name;
+	uint32_t		 type;
+	uint64_t		 config;
+};
+
+#define PERF_HW_CACHE(_c, _op, _r) \
+	((_c) | ((_op) << 8) | ((_r) << 16))
+
+static const struct perf_event perf_events[] = {
+	{ "cycles",		PERF_TYPE_HARDWARE,
+	    PERF_COUNT_HW_CPU_CYCLES },
+	{ "instructions",	PERF_TYPE_HARDWARE,
+	    PERF_COUNT_HW_INSTRUCTIONS },
+	{ "cache-references",	PERF_TYPE_HARDWARE,
+	    PERF_COUNT_HW_CACHE_REFERENCES },
+	{ "cache-misses",	PERF_TYPE_HARDWARE,
+	    PERF_COUNT_HW_CACHE_MISSES },
+	{ "branches",		PERF_TYPE_HARDWARE,
+	    PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+	{ "branch-misses",	PERF_TYPE_HARDWARE,
+	    PERF_COUNT_HW_BRANCH_MISSES },
+	{ "l1d-misses",		PERF_TYPE_HW_CACHE,
+	    PERF_HW_CACHE(PERF_COUNT_HW_CACHE_L1D,
+	    PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+	{ "llc-misses",		PERF_TYPE_HW_CACHE,
+	    PERF_HW_CACHE(PERF_COUNT_HW_CACHE_LL,
+	    PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+	{ "task-clock",		PERF_TYPE_SOFTWARE,
+	    PERF_COUNT_SW_TASK_CLOCK },
+	{ "context-switches",	PERF_TYPE_SOFTWARE,
+	    PERF_COUNT_SW_CONTEXT_SWITCHES },
+};
+
+static struct perf_event_attr perf_attrs[PERF_MAXEVENTS];
+
+static int
+perf_event(struct perf_event_attr *pea, const char *name)
+{
+	const struct perf_event *pe;
+	unsigned long long config;
+	char *end;
+	size_t i;
+
+	memset(pea, 0, sizeof(*pea));
+	pea->size = sizeof(*pea);
+	pea->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	pea->disabled = 1;
+	pea->exclude_kernel = 1;
+	pea->exclude_hv = 1;
+
+	/* raw cpu specific events, eg, r04d2 for HITM on skylake */
+	if (name[0] == 'r' && name[1] != '\0') {
+		errno = 0;
+		config = strtoull(name + 1, &end, 16);
+		if (errno != 0 || *end != '\0')
+			return (-1);
+
+		pea->type = PERF_TYPE_RAW;
+		pea->config = config;
+		return (0);
+	}
+
+	for (i = 0; i < sizeof(perf_events) / sizeof(perf_events[0]); i++) {
+		pe = &perf_events[i];
+		if (strcmp(pe->name, name) == 0) {
+			pea->type = pe->type;
+			pea->config = pe->config;
+			return (0);
+		}
+	}
+
+	return (-1);
+}
+
+int
+perf_open(struct perf *p)
+{
+	struct perf_event_attr pea;
+	unsigned int i;
+	int fd, leader = -1;
+
+	p->p_nfds = perf_n;
+	for (i = 0; i < perf_n; i++) {
+		pea = perf_attrs[i];
+		fd = syscall(SYS_perf_event_open, &pea, 0, -1, leader, 0);
+		if (fd == -1) {
+			/* this one isn't supported, try the rest */
+			p->p_fds[i] = -1;
+			continue;
+		}
+
+		if (leader == -1)
+			leader = fd;
+		p->p_fds[i] = fd;
+	}
+
+	return (leader == -1 ? -1 : 0);
+}
+
+static int
+perf_leader(struct perf *p)
+{
+	unsigned int i;
+
+	for (i = 0; i < p->p_nfds; i++) {
+		if (p->p_fds[i] != -1)
+			return (p->p_fds[i]);
+	}
+
+	return (-1);
+}
+
+void
+perf_start(struct perf *p)
+{
+	int fd = perf_leader(p);
+
+	if (fd == -1)
+		return;
+
+	ioctl(fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void
+perf_stop(struct perf *p)
+{
+	uint64_t v[3]; /* value, time enabled, time running */
+	unsigned int i;
+	int fd = perf_leader(p);
+
+	if (fd == -1)
+		return;
+
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+	for (i = 0; i < p->p_nfds; i++) {
+		fd = p->p_fds[i];
+		if (fd == -1)
+			continue;
+
+		if (read(fd, v, sizeof(v)) != sizeof(v)) {
+			close(fd);
+			p->p_fds[i] = -1;
+			continue;
+		}
+
+		/* scale the count up if the group was multiplexed */
+		if (v[2] != 0 && v[2] < v[1])
+			v[0] = (double)v[0] * v[1] / v[2];
+		p->p_counts[i] = v[0];
+	}
+
+	for (i = 0; i < p->p_nfds; i++) {
+		fd = p->p_fds[i];
+		if (fd != -1)
+			close(fd);
+	}
+}
+
+#else /* __linux__ */
+
+struct perf_event_attr {
+	int			 unused;
+};
+
+static struct perf_event_attr perf_attrs[PERF_MAXEVENTS];
+
+static int
+perf_event(struct perf_event_attr *pea, const char *name)
+{
+	return (0);
+}
+
+int
+perf_open(struct perf *p)
+{
+	p->p_nfds = 0;
+	errno = ENOSYS;
+	return (-1);
+}
+
+void
+perf_start(struct perf *p)
+{
+	/* nop */
+}
+
+void
+perf_stop(struct perf *p)
+{
+	/* nop */
+}
+
+#endif /* __linux__ */
+
+int
+perf_setup(const char *events)
+{
+	char *list, *name;
+
+	if (events == NULL)
+		events = PERF_DEFAULT;
+
+	list = strdup(events);
+	if (list == NULL)
+		err(1, "perf events");
+
+	while ((name = strsep(&list, ",")) != NULL) {
+		if (*name == '\0')
+			continue;
+		if (perf_n >= PERF_MAXEVENTS)
+			errx(1, "too many perf events");
+		if (perf_event(&perf_attrs[perf_n], name) == -1)
+			errx(1, "unknown perf event %s", name);
+
+		perf_names[perf_n++] = name;
+	}
+
+	return (perf_n);
+}
+
+unsigned int
+perf_nevents(void)
+{
+	return (perf_n);
+}
+
+const char *
+perf_name(unsigned int i)
+{
+	return (perf_names[i]);
+}
@@ -0,0 +1,24 @@
+
+/*
+ * per-thread hardware performance counters.
+ *
+ * this uses perf_event_open(2) on linux. everywhere else, or if the
+ * counters can't be opened, perf_open fails and the harness carries
+ * on without them.
+ */
+
+#define PERF_MAXEVENTS		8
+
+struct perf {
+	int			 p_fds[PERF_MAXEVENTS];
+	uint64_t		 p_counts[PERF_MAXEVENTS];
+	unsigned int		 p_nfds;
+};
+
+int		 perf_setup(const char *);
+unsigned int	 perf_nevents(void);
+const char	*perf_name(unsigned int);
+
+int		 perf_open(struct perf *);
+void		 perf_start(struct perf *);
+void		 perf_stop(struct perf *);
@@ -0,0 +1,174 @@
+/*
+ * measure the round trip time between every pair of cpus.
+ *
+ * two threads are bound to a pair of cpus, and take turns
+ * incrementing a counter. in "lock" mode they take the mutex to
+ * check and increment the counter, the same as the work loops do. in
+ * "line" mode they spin on the counter itself, which measures how
+ * long it takes the cacheline to bounce between the cpus. this is
+ * the floor for how fast any lock can be handed between them.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <err.h>
+
+#include <pthread.h>
+
+#include "atomic.h"
+#include "cpu.h"
+#include "cpuinfo.h"
+#include "lock.h"
+#include "pingpong.h"
+
+struct pingpong {
+	u_char			 mtx[MTX_MAXSIZE] __aligned(16);
+	volatile uint64_t	 v;
+	volatile unsigned int	 ready;
+	const struct lock	*lock;	/* NULL in line mode */
+	uint64_t		 rounds;
+} __aligned(128);
+
+struct pingpong_thread {
+	struct pingpong		*pp;
+	unsigned int		 me;
+	int			 cpu;
+	pthread_t		 pth;
+	uint64_t		 ns;
+	struct cpu_info		 ci;
+};
+
+static void
+pingpong_line(struct pingpong *pp, unsigned int me)
+{
+	uint64_t rounds = pp->rounds;
+	uint64_t n, v;
+
+	for (n = 0; n < rounds; n++) {
+		while (((v = pp->v) & 1) != me)
+			CPU_BUSY_CYCLE();
+		pp->v = v + 1;
+	}
+}
+
+static void *
+pingpong_thread(void *arg)
+{
+	struct pingpong_thread *ppt = arg;
+	struct pingpong *pp = ppt->pp;
+	struct timespec tick, tock, diff;
+
+	/* get onto the cpu before doing anything that gets measured */
+	if (cpu_bind(pthread_self(), ppt->cpu) == -1)
+		err(1, "bind to cpu %d", ppt->cpu);
+	cpu_info_attach(&ppt->ci, ppt->me);
+
+	/* wait for the other thread to show up */
+	atomic_inc_int_nv(&pp->ready);
+	while (pp->ready < 2)
+		CPU_BUSY_CYCLE();
+
+	if (clock_gettime(CLOCK_MONOTONIC, &tick) == -1)
+		err(1, "pingpong tick");
+	if (pp->lock != NULL)
+		pp->lock->pingpong(pp->mtx, &pp->v, ppt->me, pp->rounds);
+	else
+		pingpong_line(pp, ppt->me);
+	if (clock_gettime(CLOCK_MONOTONIC, &tock) == -1)
+		err(1, "pingpong tock");
+
+	timespecsub(&tock, &tick, &diff);
+	ppt->ns = diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+
+	return (NULL);
+}
+
+static double
+pingpong_pair(struct pingpong *pp, int a, int b)
+{
+	struct pingpong_thread ppt[2];
+	int cpus[2] = { a, b };
+	unsigned int i;
+	int error;
+
+	if (pp->lock != NULL)
+		pp->lock->init(pp->mtx);
+	pp->v = 0;
+	pp->ready = 0;
+
+	for (i = 0; i < 2; i++) {
+		ppt[i].pp = pp;
+		ppt[i].me = i;
+		ppt[i].cpu = cpus[i];
+
+		error = pthread_create(&ppt[i].pth, NULL,
+		    pingpong_thread, &ppt[i]);
+		if (error != 0)
+			errc(1, error, "pingpong create");
+	}
+
+	for (i = 0; i < 2; i++) {
+		error = pthread_join(ppt[i].pth, NULL);
+		if (error != 0)
+			errc(1, error, "pingpong join");
+	}
+
+	/* the thread that went first waited for the last round trip */
+	return ((double)ppt[0].ns / pp->rounds);
+}
+
+void
+pingpong(const struct lock *lk, const char *mode, int ncpus, uint64_t rounds)
+{
+	struct pingpong *pp;
+	double *matrix;
+	int a, b;
+
+	pp = aligned_alloc(128, sizeof(*pp));
+	if (pp == NULL)
+		err(1, "pingpong alloc");
+
+	if (strcmp(mode, "lock") == 0)
+		pp->lock = lk;
+	else if (strcmp(mode, "line") == 0)
+		pp->lock = NULL;
+	else
+		errx(1, "unknown pingpong mode %s", mode);
+	pp->rounds = rounds;
+
+	matrix = calloc((size_t)ncpus * ncpus, sizeof(*matrix));
+	if (matrix == NULL)
+		err(1, "pingpong matrix");
+
+	for (a = 0; a < ncpus; a++) {
+		for (b = a + 1; b < ncpus; b++) {
+			matrix[a * ncpus + b] = matrix[b * ncpus + a] =
+			    pingpong_pair(pp, a, b);
+		}
+	}
+
+	printf("{");
+	printf("\"lock\":\"%s\",", lk->name);
+	printf("\"pingpong\":\"%s\",", mode);
+	printf("\"rounds\":%llu,", rounds);
+	printf("\"ncpus\":%d,", ncpus);
+	printf("\"matrix\":[");
+	for (a = 0; a < ncpus; a++) {
+		printf("%s[", a ? "," : "");
+		for (b = 0; b < ncpus; b++) {
+			printf("%s%.1f", b ? "," : "",
+			    matrix[a * ncpus + b]);
+		}
+		printf("]");
+	}
+	printf("]}\n");
+
+	free(matrix);
+	free(pp);
+}
@@ -0,0 +1,3 @@
+struct lock;
+
+void	pingpong(const struct lock *, const char *, int, uint64_t);
@@ -0,0 +1,28 @@
+/*
+ * a cheap random number generator for things the threads decide on
+ * their own, like when to stall or how long to stay away for. each
+ * thread keeps its own state, which must not start at 0.
+ */
+
+#ifndef _RNG_H_
+#define _RNG_H_
+
+#include <stdint.h>
+
+#define RNG_SEED(_id)		(((uint64_t)(_id) + 1) * 0x9e3779b97f4a7c15ULL)
+
+static inline uint64_t
+rng_next(uint64_t *rng)
+{
+	uint64_t x = *rng;
+
+	/* xorshift64 */
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*rng = x;
+
+	return (x);
+}
+
+#endif /* _RNG_H_ */
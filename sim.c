@@ -0,0 +1,670 @@
+/*
+ * the virtual cpus are coroutines. each one gets its own stack, and
+ * switching between them is done with _setjmp/_longjmp. the tricky
+ * part is getting a jmp_buf that points at a new stack in the first
+ * place, which is done portably by taking a signal on the new stack
+ * with sigaltstack and calling _setjmp in the handler. see "Portable
+ * Multithreading" by Ralf S. Engelschall.
+ *
+ * fortified longjmp refuses to jump between stacks.
+ */
+#undef _FORTIFY_SOURCE
+
+#include <sys/types.h>
+
+#include <signal.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include <pthread.h>
+
+#include "sim.h"
+
+#define SIM_STACK		(256 * 1024)
+#define SIM_NTLS		4
+#define SIM_WORDS		(SIM_MAXCPUS / 64)
+#define SIM_LINESHIFT		6		/* 64 byte cachelines */
+
+#ifndef nitems
+#define nitems(_a) (sizeof((_a)) / sizeof((_a)[0]))
+#endif
+
+/*
+ * how many cycles things cost. the defaults are in the neighbourhood
+ * of a recent x86 server part.
+ */
+
+struct sim_model {
+	uint64_t		 hit;		/* access a line we have */
+	uint64_t		 llc;		/* fill a line from the llc */
+	uint64_t		 near;		/* line from a cpu on our socket */
+	uint64_t		 hop;		/* ... plus this per cpu apart */
+	uint64_t		 far;		/* line from another socket */
+	uint64_t		 atomic;	/* extra for a locked op */
+	uint64_t		 fence;		/* a full memory barrier */
+	uint64_t		 pause;		/* CPU_BUSY_CYCLE */
+	uint64_t		 socket;	/* cpus per socket */
+	double			 ghz;
+};
+
+static struct sim_model sim_model = {
+	.hit =		4,
+	.llc =		40,
+	.near =		60,
+	.hop =		1,
+	.far =		300,
+	.atomic =	20,
+	.fence =	30,
+	.pause =	40,
+	.socket =	32,
+	.ghz =		2.0,
+};
+
+static const struct {
+	const char		*name;
+	uint64_t		*value;
+} sim_params[] = {
+	{ "hit",	&sim_model.hit },
+	{ "llc",	&sim_model.llc },
+	{ "near",	&sim_model.near },
+	{ "hop",	&sim_model.hop },
+	{ "far",	&sim_model.far },
+	{ "atomic",	&sim_model.atomic },
+	{ "fence",	&sim_model.fence },
+	{ "pause",	&sim_model.pause },
+	{ "socket",	&sim_model.socket },
+};
+
+struct sim_stats {
+	uint64_t		 ss_events;	/* scheduling points */
+	uint64_t		 ss_hits;	/* accesses to lines we had */
+	uint64_t		 ss_fills;	/* lines from the llc */
+	uint64_t		 ss_xfers;	/* lines from another cpu */
+	uint64_t		 ss_remote;	/* ... on another socket */
+	uint64_t		 ss_invals;	/* copies invalidated */
+	uint64_t		 ss_stalls;	/* cycles queued on busy lines */
+};
+
+struct sim_cpu {
+	jmp_buf			 sc_jb;
+	uint64_t		 sc_clock;
+	unsigned int		 sc_id;
+	void			*(*sc_fn)(void *);
+	void			*sc_arg;
+	void			*sc_stack;
+	void			*sc_tls[SIM_NTLS];
+};
+
+/*
+ * what we know about each cacheline. a line is either held
+ * exclusively (ie, modified or exclusive) by one cpu, or shared
+ * by a set of cpus, or only in the llc.
+ */
+
+struct sim_line {
+	uintptr_t		 sl_tag;	/* line number + 1, 0 is free */
+	uint64_t		 sl_busy;	/* moving until this cycle */
+	int			 sl_owner;	/* exclusive holder or -1 */
+	uint64_t		 sl_sharers[SIM_WORDS];
+};
+
+static struct sim_cpu	*sim_cpus[SIM_MAXCPUS];
+static unsigned int	 sim_ncpus;
+static struct sim_cpu	*sim_cur;
+static uint64_t		 sim_clock;
+static jmp_buf		 sim_main;
+static void		*sim_main_tls[SIM_NTLS];
+
+/* runnable cpus, a min heap on their clocks */
+static struct sim_cpu	*sim_heap[SIM_MAXCPUS];
+static unsigned int	 sim_nheap;
+
+static void		**sim_tlsp[SIM_NTLS];
+static unsigned int	 sim_ntls;
+
+static struct sim_line	*sim_lines;
+static size_t		 sim_nlines;
+static size_t		 sim_maxlines;
+
+static struct sim_stats	 sim_st;
+
+static struct sim_cpu	*volatile sim_boot;
+
+int
+sim_config(const char *spec)
+{
+	char *list, *item, *val, *end;
+	const char *errstr;
+	size_t i;
+
+	list = strdup(spec);
+	if (list == NULL)
+		err(1, "sim config");
+
+	while ((item = strsep(&list, ",")) != NULL) {
+		val = strchr(item, '=');
+		if (val == NULL) {
+			warnx("sim %s: expected name=value", item);
+			return (-1);
+		}
+		*val++ = '\0';
+
+		if (strcmp(item, "ghz") == 0) {
+			sim_model.ghz = strtod(val, &end);
+			if (*end != '\0' || sim_model.ghz <= 0) {
+				warnx("sim ghz %s: invalid", val);
+				return (-1);
+			}
+			continue;
+		}
+
+		for (i = 0; i < nitems(sim_params); i++) {
+			if (strcmp(sim_params[i].name, item) == 0)
+				break;
+		}
+		if (i == nitems(sim_params)) {
+			warnx("sim %s: unknown parameter", item);
+			return (-1);
+		}
+
+		*sim_params[i].value = strtonum(val, 0, 1000000, &errstr);
+		if (errstr != NULL) {
+			warnx("sim %s %s: %s", item, val, errstr);
+			return (-1);
+		}
+	}
+
+	if (sim_model.socket == 0) {
+		warnx("sim socket: must have at least one cpu");
+		return (-1);
+	}
+
+	return (0);
+}
+
+double
+sim_hz(void)
+{
+	return (sim_model.ghz * 1000000000.0);
+}
+
+double
+sim_pause_ns(void)
+{
+	return (sim_model.pause / sim_model.ghz);
+}
+
+void
+sim_print(void)
+{
+	size_t i;
+
+	printf("\"sim\":{");
+	for (i = 0; i < nitems(sim_params); i++) {
+		printf("\"%s\":%llu,", sim_params[i].name,
+		    (unsigned long long)*sim_params[i].value);
+	}
+	printf("\"ghz\":%g,", sim_model.ghz);
+	printf("\"events\":%llu,", (unsigned long long)sim_st.ss_events);
+	printf("\"hits\":%llu,", (unsigned long long)sim_st.ss_hits);
+	printf("\"fills\":%llu,", (unsigned long long)sim_st.ss_fills);
+	printf("\"xfers\":%llu,", (unsigned long long)sim_st.ss_xfers);
+	printf("\"remote\":%llu,", (unsigned long long)sim_st.ss_remote);
+	printf("\"invals\":%llu,", (unsigned long long)sim_st.ss_invals);
+	printf("\"stalls\":%llu", (unsigned long long)sim_st.ss_stalls);
+	printf("}");
+}
+
+/*
+ * register a thread local variable that each virtual cpu needs its
+ * own copy of.
+ */
+
+void
+sim_tls(void **p)
+{
+	if (sim_ntls >= SIM_NTLS)
+		errx(1, "too many sim tls variables");
+
+	sim_tlsp[sim_ntls++] = p;
+}
+
+uint64_t
+sim_now(void)
+{
+	struct sim_cpu *c = sim_cur;
+
+	return (c == NULL ? sim_clock : c->sc_clock);
+}
+
+uintptr_t
+sim_self(void)
+{
+	struct sim_cpu *c = sim_cur;
+
+	/* malloc aligns the struct, so the low bit is free for the locks */
+	return ((uintptr_t)(c == NULL ? (void *)&sim_main : (void *)c));
+}
+
+/*
+ * the run queue.
+ */
+
+static inline int
+sim_before(const struct sim_cpu *a, const struct sim_cpu *b)
+{
+	if (a->sc_clock != b->sc_clock)
+		return (a->sc_clock < b->sc_clock);
+
+	return (a->sc_id < b->sc_id);
+}
+
+static void
+sim_heap_down(unsigned int i)
+{
+	struct sim_cpu *c = sim_heap[i];
+	unsigned int n;
+
+	for (;;) {
+		n = i * 2 + 1;
+		if (n >= sim_nheap)
+			break;
+		if (n + 1 < sim_nheap &&
+		    sim_before(sim_heap[n + 1], sim_heap[n]))
+			n++;
+		if (!sim_before(sim_heap[n], c))
+			break;
+		sim_heap[i] = sim_heap[n];
+		i = n;
+	}
+	sim_heap[i] = c;
+}
+
+static void
+sim_heap_push(struct sim_cpu *c)
+{
+	unsigned int i = sim_nheap++;
+	unsigned int p;
+
+	while (i > 0) {
+		p = (i - 1) / 2;
+		if (!sim_before(c, sim_heap[p]))
+			break;
+		sim_heap[i] = sim_heap[p];
+		i = p;
+	}
+	sim_heap[i] = c;
+}
+
+static struct sim_cpu *
+sim_heap_pop(void)
+{
+	struct sim_cpu *c = sim_heap[0];
+
+	sim_heap[0] = sim_heap[--sim_nheap];
+	if (sim_nheap > 0)
+		sim_heap_down(0);
+
+	return (c);
+}
+
+static void
+sim_tls_load(void * const *tls)
+{
+	unsigned int i;
+
+	for (i = 0; i < sim_ntls; i++)
+		*sim_tlsp[i] = tls[i];
+}
+
+static void
+sim_tls_save(void **tls)
+{
+	unsigned int i;
+
+	for (i = 0; i < sim_ntls; i++)
+		tls[i] = *sim_tlsp[i];
+}
+
+static void
+sim_switch(struct sim_cpu *from, struct sim_cpu *to)
+{
+	sim_tls_save(from->sc_tls);
+	sim_tls_load(to->sc_tls);
+	sim_cur = to;
+
+	if (_setjmp(from->sc_jb) == 0)
+		_longjmp(to->sc_jb, 1);
+}
+
+/*
+ * let any cpu that is behind us in virtual time catch up.
+ */
+
+static void
+sim_yield(struct sim_cpu *c)
+{
+	struct sim_cpu *n;
+
+	sim_st.ss_events++;
+
+	if (sim_nheap == 0 || sim_before(c, sim_heap[0]))
+		return;
+
+	n = sim_heap[0];
+	sim_heap[0] = c;
+	sim_heap_down(0);
+
+	sim_switch(c, n);
+}
+
+static __dead void
+sim_exit(struct sim_cpu *c)
+{
+	struct sim_cpu *n;
+
+	if (c->sc_clock > sim_clock)
+		sim_clock = c->sc_clock;
+
+	sim_tls_save(c->sc_tls);
+	if (sim_nheap == 0) {
+		sim_tls_load(sim_main_tls);
+		sim_cur = NULL;
+		_longjmp(sim_main, 1);
+	}
+
+	n = sim_heap_pop();
+	sim_tls_load(n->sc_tls);
+	sim_cur = n;
+	_longjmp(n->sc_jb, 1);
+}
+
+static __dead void
+sim_start(void)
+{
+	struct sim_cpu *c = sim_cur;
+
+	c->sc_fn(c->sc_arg);
+	sim_exit(c);
+}
+
+static void
+sim_boot_handler(int sig)
+{
+	if (_setjmp(sim_boot->sc_jb) == 0)
+		return;
+
+	/* we come back here when the cpu first runs */
+	sim_start();
+}
+
+int
+sim_spawn(void *(*fn)(void *), void *arg)
+{
+	struct sim_cpu *c;
+	struct sigaction sa, osa;
+	sigset_t set, oset;
+	stack_t ss, oss;
+
+	if (sim_ncpus >= SIM_MAXCPUS)
+		errx(1, "too many sim cpus");
+
+	c = calloc(1, sizeof(*c));
+	if (c == NULL)
+		return (-1);
+	c->sc_stack = malloc(SIM_STACK);
+	if (c->sc_stack == NULL) {
+		free(c);
+		return (-1);
+	}
+	c->sc_id = sim_ncpus;
+	c->sc_clock = sim_clock;
+	c->sc_fn = fn;
+	c->sc_arg = arg;
+
+	ss.ss_sp = c->sc_stack;
+	ss.ss_size = SIM_STACK;
+	ss.ss_flags = 0;
+	if (sigaltstack(&ss, &oss) == -1)
+		err(1, "sigaltstack");
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sim_boot_handler;
+	sa.sa_flags = SA_ONSTACK;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGUSR2, &sa, &osa) == -1)
+		err(1, "sigaction");
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR2);
+	sigprocmask(SIG_UNBLOCK, &set, &oset);
+
+	sim_boot = c;
+	raise(SIGUSR2);
+
+	sigprocmask(SIG_SETMASK, &oset, NULL);
+	if (sigaction(SIGUSR2, &osa, NULL) == -1)
+		err(1, "sigaction restore");
+	if (sigaltstack(&oss, NULL) == -1)
+		err(1, "sigaltstack restore");
+
+	sim_cpus[sim_ncpus++] = c;
+	sim_heap_push(c);
+
+	return (0);
+}
+
+/*
+ * run the spawned cpus until they've all finished.
+ */
+
+void
+sim_run(void)
+{
+	struct sim_cpu *c;
+	unsigned int i;
+
+	memset(&sim_st, 0, sizeof(sim_st));
+	if (sim_lines != NULL)
+		memset(sim_lines, 0, sim_maxlines * sizeof(*sim_lines));
+	sim_nlines = 0;
+
+	sim_tls_save(sim_main_tls);
+	for (i = 0; i < sim_ncpus; i++)
+		memcpy(sim_cpus[i]->sc_tls, sim_main_tls,
+		    sizeof(sim_main_tls));
+
+	if (sim_nheap > 0 && _setjmp(sim_main) == 0) {
+		c = sim_heap_pop();
+		sim_tls_load(c->sc_tls);
+		sim_cur = c;
+		_longjmp(c->sc_jb, 1);
+	}
+
+	for (i = 0; i < sim_ncpus; i++) {
+		free(sim_cpus[i]->sc_stack);
+		free(sim_cpus[i]);
+		sim_cpus[i] = NULL;
+	}
+	sim_ncpus = 0;
+}
+
+/*
+ * the cache model.
+ */
+
+static struct sim_line *
+sim_line(const volatile void *addr)
+{
+	uintptr_t tag = ((uintptr_t)addr >> SIM_LINESHIFT) + 1;
+	struct sim_line *l, *olines;
+	size_t i, omax;
+
+	if (sim_nlines * 2 >= sim_maxlines) {
+		olines = sim_lines;
+		omax = sim_maxlines;
+
+		sim_maxlines = omax ? omax * 2 : 1024;
+		sim_lines = calloc(sim_maxlines, sizeof(*sim_lines));
+		if (sim_lines == NULL)
+			err(1, "sim lines");
+		sim_nlines = 0;
+
+		for (i = 0; i < omax; i++) {
+			if (olines[i].sl_tag == 0)
+				continue;
+			l = sim_line((void *)((olines[i].sl_tag - 1) <<
+			    SIM_LINESHIFT));
+			memcpy(l, &olines[i], sizeof(*l));
+		}
+		free(olines);
+	}
+
+	i = (tag * 0x9e3779b97f4a7c15ULL) & (sim_maxlines - 1);
+	for (;;) {
+		l = &sim_lines[i];
+		if (l->sl_tag == tag)
+			return (l);
+		if (l->sl_tag == 0)
+			break;
+		i = (i + 1) & (sim_maxlines - 1);
+	}
+
+	l->sl_tag = tag;
+	l->sl_owner = -1;
+	sim_nlines++;
+
+	return (l);
+}
+
+static uint64_t
+sim_xfer(unsigned int from, unsigned int to)
+{
+	if (from / sim_model.socket != to / sim_model.socket) {
+		sim_st.ss_remote++;
+		return (sim_model.far);
+	}
+
+	return (sim_model.near +
+	    sim_model.hop * (from > to ? from - to : to - from));
+}
+
+static inline int
+sim_shared(const struct sim_line *l, unsigned int id)
+{
+	return ((l->sl_sharers[id / 64] >> (id % 64)) & 1);
+}
+
+static inline void
+sim_share(struct sim_line *l, unsigned int id)
+{
+	l->sl_sharers[id / 64] |= 1ULL << (id % 64);
+}
+
+void
+sim_access(const volatile void *addr, int op)
+{
+	struct sim_cpu *c = sim_cur;
+	struct sim_line *l;
+	unsigned int me, id, w;
+	uint64_t cost = 0, xfer = 0, bits, t, start;
+
+	if (c == NULL)
+		return;
+
+	sim_yield(c);
+
+	me = c->sc_id;
+	l = sim_line(addr);
+
+	if (op == SIM_LOAD) {
+		if (l->sl_owner == (int)me || sim_shared(l, me)) {
+			cost = sim_model.hit;
+			sim_st.ss_hits++;
+		} else if (l->sl_owner != -1) {
+			/* someone has it modified, they have to share it */
+			xfer = sim_xfer(l->sl_owner, me);
+			sim_share(l, l->sl_owner);
+			sim_share(l, me);
+			l->sl_owner = -1;
+			sim_st.ss_xfers++;
+		} else {
+			cost = sim_model.llc;
+			sim_st.ss_fills++;
+			sim_share(l, me);
+		}
+	} else {
+		if (l->sl_owner == (int)me) {
+			cost = sim_model.hit;
+			sim_st.ss_hits++;
+		} else {
+			if (l->sl_owner != -1) {
+				xfer = sim_xfer(l->sl_owner, me);
+				sim_st.ss_xfers++;
+				sim_st.ss_invals++;
+			} else {
+				/* wait for every other copy to go away */
+				xfer = sim_model.llc;
+				for (w = 0; w < SIM_WORDS; w++) {
+					bits = l->sl_sharers[w];
+					while (bits != 0) {
+						id = w * 64 +
+						    __builtin_ctzll(bits);
+						bits &= bits - 1;
+						if (id == me)
+							continue;
+						t = sim_xfer(id, me);
+						if (t > xfer)
+							xfer = t;
+						sim_st.ss_invals++;
+					}
+				}
+				sim_st.ss_fills++;
+			}
+
+			memset(l->sl_sharers, 0, sizeof(l->sl_sharers));
+			l->sl_owner = me;
+		}
+
+		if (op == SIM_RMW)
+			cost += sim_model.atomic;
+	}
+
+	if (xfer > 0) {
+		/* a line can only be moving to one cpu at a time */
+		start = c->sc_clock;
+		if (l->sl_busy > start) {
+			sim_st.ss_stalls += l->sl_busy - start;
+			start = l->sl_busy;
+		}
+		l->sl_busy = start + xfer;
+		c->sc_clock = l->sl_busy;
+	}
+
+	c->sc_clock += cost;
+}
+
+void
+sim_pause(void)
+{
+	struct sim_cpu *c = sim_cur;
+
+	if (c == NULL)
+		return;
+
+	c->sc_clock += sim_model.pause;
+	sim_yield(c);
+}
+
+void
+sim_fence(void)
+{
+	struct sim_cpu *c = sim_cur;
+
+	if (c != NULL)
+		c->sc_clock += sim_model.fence;
+}
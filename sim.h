@@ -0,0 +1,105 @@
+/*
+ * a deterministic simulation of cpus fighting over cachelines.
+ *
+ * when the tests are built with MTX_SIM defined, the atomic ops,
+ * READ_ONCE/WRITE_ONCE, memory barriers, and CPU_BUSY_CYCLE used
+ * by the mutex implementations are redirected here. the threads in
+ * the harness become virtual cpus that run as coroutines on a single
+ * real thread, and every access to memory made through those ops
+ * is charged a number of cycles based on the state of the cacheline
+ * it touches and how far away the cpu that has the line is.
+ *
+ * the virtual cpu with the lowest clock always runs next, so each
+ * access happens in order of virtual time and a run with the same
+ * arguments always does exactly the same thing, regardless of how
+ * many real cpus the machine running it has.
+ *
+ * plain loads and stores are not seen by the simulation, and are
+ * free.
+ */
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdint.h>
+
+#define SIM_MAXCPUS		1024
+
+#define SIM_LOAD		0
+#define SIM_STORE		1
+#define SIM_RMW			2
+
+int	 sim_config(const char *);
+void	 sim_print(void);
+double	 sim_hz(void);
+double	 sim_pause_ns(void);
+
+int	 sim_spawn(void *(*)(void *), void *);
+void	 sim_run(void);
+void	 sim_tls(void **);
+
+uint64_t sim_now(void);
+uintptr_t sim_self(void);
+void	 sim_access(const volatile void *, int);
+void	 sim_pause(void);
+void	 sim_fence(void);
+
+#define CPU_BUSY_CYCLE()	sim_pause()
+
+#define READ_ONCE(x) ({							\
+	sim_access(&(x), SIM_LOAD);					\
+	*(volatile typeof(x) *)&(x);					\
+})
+
+#define WRITE_ONCE(x, val) ({						\
+	typeof(x) __tmp = (val);					\
+	sim_access(&(x), SIM_STORE);					\
+	*(volatile typeof(x) *)&(x) = __tmp;				\
+	__tmp;								\
+})
+
+#define sim_cas(_p, _e, _n) ({						\
+	volatile typeof(*(_p)) *__p = (_p);				\
+	typeof(*(_p)) __o;						\
+	sim_access(__p, SIM_RMW);					\
+	__o = *__p;							\
+	if (__o == (typeof(*(_p)))(_e))					\
+		*__p = (typeof(*(_p)))(_n);				\
+	__o;								\
+})
+
+#define atomic_cas_uint(_p, _e, _n)	sim_cas((_p), (_e), (_n))
+#define atomic_cas_ulong(_p, _e, _n)	sim_cas((_p), (_e), (_n))
+#define atomic_cas_ptr(_p, _e, _n)	sim_cas((_p), (_e), (_n))
+
+#define atomic_swap_ptr(_p, _n) ({					\
+	volatile typeof(*(_p)) *__p = (_p);				\
+	typeof(*(_p)) __o;						\
+	sim_access(__p, SIM_RMW);					\
+	__o = *__p;							\
+	*__p = (typeof(*(_p)))(_n);					\
+	__o;								\
+})
+
+#define atomic_add_int_nv(_p, _v) ({					\
+	volatile unsigned int *__p = (_p);				\
+	sim_access(__p, SIM_RMW);					\
+	*__p += (_v);							\
+})
+#define atomic_inc_int_nv(_p)		atomic_add_int_nv((_p), 1)
+#define atomic_dec_int_nv(_p)		atomic_add_int_nv((_p), -1)
+
+/* amd64 only needs a real barrier for store then load ordering */
+#define membar_enter()			sim_fence()
+#define membar_sync()			sim_fence()
+#define membar_exit()			__asm volatile("" ::: "memory")
+#define membar_producer()		__asm volatile("" ::: "memory")
+#define membar_consumer()		__asm volatile("" ::: "memory")
+#define membar_enter_after_atomic()	__asm volatile("" ::: "memory")
+#define membar_exit_before_atomic()	__asm volatile("" ::: "memory")
+
+/* each virtual cpu is its own thread as far as the locks can tell */
+#undef pthread_self
+#define pthread_self()			((pthread_t)sim_self())
+
+#endif /* _SIM_H_ */
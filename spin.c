@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <err.h>
+
+#include "spin.h"
+
+#define SPIN_BATCH		1000	/* CPU_BUSY_CYCLEs per measurement */
+#define SPIN_TRIES		16
+
+/*
+ * budgets that aren't set with -s keep the fixed counts the locks
+ * have always used, so results stay comparable with older ones. with
+ * a 20ns CPU_BUSY_CYCLE, which is what the simulated cpus charge for
+ * one, they work out to 800, 20, and 2000ns.
+ */
+unsigned int spin_ps = 20000;
+unsigned int spin_budgets[SPIN_NBUDGETS];
+unsigned int spin_counts[SPIN_NBUDGETS] = {
+	[SPIN_MEDIUM] =		40,
+	[SPIN_BACKOFF] =	1,	/* per cpu */
+	[SPIN_WORK] =		100,
+};
+static int spin_set[SPIN_NBUDGETS];	/* given with -s */
+
+static const char *spin_names[] = SPIN_NAMES;
+
+int
+spin_config(const char *spec)
+{
+	char *list, *item, *val;
+	const char *errstr;
+	size_t i;
+
+	list = strdup(spec);
+	if (list == NULL)
+		err(1, "spin config");
+
+	while ((item = strsep(&list, ",")) != NULL) {
+		val = strchr(item, '=');
+		if (val == NULL) {
+			warnx("spin %s: expected name=nsec", item);
+			return (-1);
+		}
+		*val++ = '\0';
+
+		for (i = 0; i < nitems(spin_names); i++) {
+			if (strcmp(spin_names[i], item) == 0)
+				break;
+		}
+		if (i == nitems(spin_names)) {
+			warnx("spin %s: unknown budget", item);
+			return (-1);
+		}
+
+		spin_budgets[i] = strtonum(val, 0, 10000000, &errstr);
+		if (errstr != NULL) {
+			warnx("spin %s %s: %s", item, val, errstr);
+			return (-1);
+		}
+		spin_set[i] = 1;
+	}
+
+	return (0);
+}
+
+/*
+ * time batches of CPU_BUSY_CYCLEs against the monotonic clock and
+ * keep the fastest, which is the one least disturbed by interrupts
+ * and other threads.
+ */
+
+void
+spin_calibrate(void)
+{
+#ifndef MTX_SIM
+	struct timespec tick, tock, diff;
+	uint64_t ns, best = UINT64_MAX;
+#endif
+	unsigned int i;
+
+#ifdef MTX_SIM
+	spin_ps = sim_pause_ns() * 1000.0;
+#else
+	for (i = 0; i < SPIN_TRIES; i++) {
+		if (clock_gettime(CLOCK_MONOTONIC, &tick) == -1)
+			err(1, "spin tick");
+		spin_wait(SPIN_BATCH);
+		if (clock_gettime(CLOCK_MONOTONIC, &tock) == -1)
+			err(1, "spin tock");
+
+		timespecsub(&tock, &tick, &diff);
+		ns = diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+		if (ns < best)
+			best = ns;
+	}
+
+	spin_ps = best * 1000 / SPIN_BATCH;
+#endif
+	if (spin_ps == 0)
+		spin_ps = 1;
+
+	for (i = 0; i < SPIN_NBUDGETS; i++) {
+		if (!spin_set[i]) {
+			/* report what the fixed count spins for here */
+			spin_budgets[i] = ((uint64_t)spin_counts[i] * spin_ps +
+			    500) / 1000;
+			continue;
+		}
+
+		spin_counts[i] = spin_count(spin_budgets[i]);
+		/* a short budget on a slow cpu still spins */
+		if (spin_counts[i] == 0 && spin_budgets[i] > 0)
+			spin_counts[i] = 1;
+	}
+}
+
+void
+spin_print(void)
+{
+	size_t i;
+
+	printf("\"spin\":{");
+	printf("\"pause_ps\":%u", spin_ps);
+	for (i = 0; i < SPIN_NBUDGETS; i++)
+		printf(",\"%s\":%u", spin_names[i], spin_budgets[i]);
+	printf("}");
+}
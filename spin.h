@@ -0,0 +1,59 @@
+/*
+ * spin budgets in nanoseconds.
+ *
+ * how long a CPU_BUSY_CYCLE takes depends a lot on the cpu. pause
+ * is about 10 cycles on some x86 parts and about 140 on others, so
+ * spinning a fixed number of times means very different things on
+ * different machines. the harness measures what a CPU_BUSY_CYCLE
+ * costs at startup, and turns each of the budgets given with -s from
+ * nanoseconds into a number of CPU_BUSY_CYCLEs that the mutex
+ * implementations and work loops can spin for. budgets that aren't
+ * given keep their old fixed counts.
+ *
+ * the budgets only cover the CPU_BUSY_CYCLEs. a spin loop that also
+ * reads a contended lock word every time around will take longer.
+ */
+
+#ifndef _SPIN_H_
+#define _SPIN_H_
+
+#include <stdint.h>
+
+#include "atomic.h"
+
+enum spin_budget {
+	SPIN_MEDIUM,		/* parking locks spinning before parking */
+	SPIN_BACKOFF,		/* most backoff between attempts, per cpu */
+	SPIN_WORK,		/* work loops holding or waiting for the lock */
+
+	SPIN_NBUDGETS
+};
+
+#define SPIN_NAMES { "medium", "backoff", "work" }
+
+extern unsigned int spin_ps;			/* per CPU_BUSY_CYCLE */
+extern unsigned int spin_budgets[SPIN_NBUDGETS];	/* nanoseconds */
+extern unsigned int spin_counts[SPIN_NBUDGETS];	/* CPU_BUSY_CYCLEs */
+
+int	spin_config(const char *);
+void	spin_calibrate(void);
+void	spin_print(void);
+
+/*
+ * how many CPU_BUSY_CYCLEs take ns nanoseconds. a -D stall can ask
+ * for seconds, which is more than an unsigned int of them.
+ */
+static inline uint64_t
+spin_count(uint64_t ns)
+{
+	return ((ns * 1000 + spin_ps / 2) / spin_ps);
+}
+
+static inline void
+spin_wait(uint64_t n)
+{
+	while (n-- > 0)
+		CPU_BUSY_CYCLE();
+}
+
+#endif /* _SPIN_H_ */
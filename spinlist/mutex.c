@@ -2,6 +2,7 @@
 
 #include <mutex.h>
 #include "../atomic.h"
+#include "../lockstat.h"
 
 struct mutex_waiter {
 	unsigned int wait;
@@ -12,16 +13,19 @@ void
 mtx_init(struct mutex *mtx)
 {
 	mtx->mtx_spin = 0;
-	mtx->mtx_owner = NULL;
+	mtx->mtx_owner = 0;
 	TAILQ_INIT(&mtx->mtx_waiting);
 }
 
 static void
 mtx_enter_spin(struct mutex *mtx)
 {
-	while (atomic_cas_uint(&mtx->mtx_spin, 0, 1) != 0)
+	while (atomic_cas_uint(&mtx->mtx_spin, 0, 1) != 0) {
 		CPU_BUSY_CYCLE();
+		LOCKSTAT_INC(LS_BUCKET_SPINS);
+	}
 	membar_enter_after_atomic();
+	LOCKSTAT_INC(LS_BUCKET);
 }
 
 static void
@@ -39,11 +43,11 @@ mtx_enter_try(struct mutex *mtx)
 
 	mtx_enter_spin(mtx);
 	owner = mtx->mtx_owner;
-	if (owner == NULL)
+	if (owner == 0)
 		mtx->mtx_owner = self;
 	mtx_leave_spin(mtx);
 
-	return (owner == NULL);
+	return (owner == 0);
 }
 
 void
@@ -55,9 +59,11 @@ mtx_enter(struct mutex *mtx)
 
 	mtx_enter_spin(mtx);
 	owner = mtx->mtx_owner;
-	if (owner == NULL)
+	if (owner == 0) {
 		mtx->mtx_owner = self;
-	else {
+		LOCKSTAT_INC(LS_FAST);
+	} else {
+		LOCKSTAT_INC(LS_PARK);
 		if (mtx->mtx_waiting.tqh_last == NULL) { /* sigh */
 			/* work around TAILQ_HEAD_INITIALIZER */
 			mtx->mtx_waiting.tqh_last =
@@ -68,17 +74,21 @@ mtx_enter(struct mutex *mtx)
 	}
 	mtx_leave_spin(mtx);
 
-	while (owner != NULL) {
-		while (READ_ONCE(w.wait))
+	while (owner != 0) {
+		while (READ_ONCE(w.wait)) {
 			CPU_BUSY_CYCLE();
+			LOCKSTAT_INC(LS_PARK_SPINS);
+		}
 
 		mtx_enter_spin(mtx);
 		owner = mtx->mtx_owner;
-		if (owner == NULL) {
+		if (owner == 0) {
 			mtx->mtx_owner = self;
 			TAILQ_REMOVE(&mtx->mtx_waiting, &w, entry);
-		} else
+		} else {
+			LOCKSTAT_INC(LS_STEAL);
 			w.wait = 1;
+		}
 		mtx_leave_spin(mtx);
 	}
 }
@@ -89,9 +99,11 @@ mtx_leave(struct mutex *mtx)
 	struct mutex_waiter *n;
 
 	mtx_enter_spin(mtx);
-	mtx->mtx_owner = NULL;
+	mtx->mtx_owner = 0;
 	n = TAILQ_FIRST(&mtx->mtx_waiting);
-	if (n != NULL)
+	if (n != NULL) {
+		LOCKSTAT_INC(LS_HANDOFF);
 		n->wait = 0;
+	}
 	mtx_leave_spin(mtx);
 }
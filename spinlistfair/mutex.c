@@ -2,6 +2,7 @@
 
 #include <mutex.h>
 #include "../atomic.h"
+#include "../lockstat.h"
 
 struct mutex_waiter {
 	pthread_t self;
@@ -12,16 +13,19 @@ void
 mtx_init(struct mutex *mtx)
 {
 	mtx->mtx_spin = 0;
-	mtx->mtx_owner = NULL;
+	mtx->mtx_owner = 0;
 	TAILQ_INIT(&mtx->mtx_waiting);
 }
 
 static void
 mtx_enter_spin(struct mutex *mtx)
 {
-	while (atomic_cas_uint(&mtx->mtx_spin, 0, 1) != 0)
+	while (atomic_cas_uint(&mtx->mtx_spin, 0, 1) != 0) {
 		CPU_BUSY_CYCLE();
+		LOCKSTAT_INC(LS_BUCKET_SPINS);
+	}
 	membar_enter_after_atomic();
+	LOCKSTAT_INC(LS_BUCKET);
 }
 
 static void
@@ -39,11 +43,11 @@ mtx_enter_try(struct mutex *mtx)
 
 	mtx_enter_spin(mtx);
 	owner = mtx->mtx_owner;
-	if (owner == NULL)
+	if (owner == 0)
 		mtx->mtx_owner = self;
 	mtx_leave_spin(mtx);
 
-	return (owner == NULL);
+	return (owner == 0);
 }
 
 void
@@ -55,9 +59,11 @@ mtx_enter(struct mutex *mtx)
 
 	mtx_enter_spin(mtx);
 	owner = mtx->mtx_owner;
-	if (owner == NULL)
+	if (owner == 0) {
 		mtx->mtx_owner = self;
-	else {
+		LOCKSTAT_INC(LS_FAST);
+	} else {
+		LOCKSTAT_INC(LS_PARK);
 		if (mtx->mtx_waiting.tqh_last == NULL) { /* sigh */
 			/* work around TAILQ_HEAD_INITIALIZER */
 			mtx->mtx_waiting.tqh_last =
@@ -68,9 +74,11 @@ mtx_enter(struct mutex *mtx)
 	}
 	mtx_leave_spin(mtx);
 
-	if (owner != NULL) {
-		while (READ_ONCE(w.self))
+	if (owner != 0) {
+		while (READ_ONCE(w.self)) {
 			CPU_BUSY_CYCLE();
+			LOCKSTAT_INC(LS_PARK_SPINS);
+		}
 	}
 }
 
@@ -82,12 +90,13 @@ mtx_leave(struct mutex *mtx)
 	mtx_enter_spin(mtx);
 	n = TAILQ_FIRST(&mtx->mtx_waiting);
 	if (n == NULL)
-		mtx->mtx_owner = NULL;
+		mtx->mtx_owner = 0;
 	else {
 		/* move ownership */
+		LOCKSTAT_INC(LS_HANDOFF);
 		TAILQ_REMOVE(&mtx->mtx_waiting, n, entry);
 		mtx->mtx_owner = n->self;
-		n->self = NULL;
+		n->self = 0;
 	}
 	mtx_leave_spin(mtx);
 }
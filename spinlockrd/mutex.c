@@ -12,11 +12,12 @@
 
 #include <mutex.h>
 #include "../atomic.h"
+#include "../lockstat.h"
 
 void
 mtx_init(struct mutex *mtx)
 {
-	mtx->mtx_owner = NULL;
+	mtx->mtx_owner = 0;
 }
 
 int
@@ -25,8 +26,8 @@ mtx_enter_try(struct mutex *mtx)
 	pthread_t self = pthread_self();
 	pthread_t owner;
 
-	owner = atomic_cas_ptr(&mtx->mtx_owner, NULL, self);
-	if (owner == NULL) {
+	owner = atomic_cas_ptr(&mtx->mtx_owner, 0, self);
+	if (owner == 0) {
 		membar_enter_after_atomic();
 		return (1);
 	}
@@ -37,16 +38,23 @@ mtx_enter_try(struct mutex *mtx)
 void
 mtx_enter(struct mutex *mtx)
 {
-	while (mtx_enter_try(mtx) == 0) {
+	if (mtx_enter_try(mtx)) {
+		LOCKSTAT_INC(LS_FAST);
+		return;
+	}
+
+	do {
 		do {
 			CPU_BUSY_CYCLE();
-		} while (mtx->mtx_owner != NULL);
-	}
+			LOCKSTAT_INC(LS_SPINS);
+		} while (mtx->mtx_owner != 0);
+	} while (mtx_enter_try(mtx) == 0);
+	LOCKSTAT_INC(LS_SPIN);
 }
 
 void
 mtx_leave(struct mutex *mtx)
 {
 	membar_exit();
-	mtx->mtx_owner = NULL;
+	mtx->mtx_owner = 0;
 }
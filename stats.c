@@ -0,0 +1,66 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <err.h>
+
+#include "stats.h"
+
+static int
+dcmp(const void *a, const void *b)
+{
+	double da = *(const double *)a;
+	double db = *(const double *)b;
+
+	return ((da > db) - (da < db));
+}
+
+static double
+median(const double *v, size_t n)
+{
+	if (n & 1)
+		return (v[n / 2]);
+
+	return ((v[n / 2 - 1] + v[n / 2]) / 2.0);
+}
+
+void
+summarise(const double *values, size_t n, struct summary *sum)
+{
+	double *v;
+	double half;
+	long lo, hi;
+	size_t i;
+
+	memset(sum, 0, sizeof(*sum));
+	sum->n = n;
+	if (n == 0)
+		return;
+
+	v = reallocarray(NULL, n, sizeof(*v));
+	if (v == NULL)
+		err(1, "summarise");
+
+	memcpy(v, values, n * sizeof(*v));
+	qsort(v, n, sizeof(*v), dcmp);
+
+	sum->median = median(v, n);
+
+	/* the ranks of the order statistics around the median */
+	half = 1.96 * sqrt(n) / 2.0;
+	lo = floor(n / 2.0 - half);
+	hi = ceil(1 + n / 2.0 + half);
+	if (lo < 1)
+		lo = 1;
+	if (hi > (long)n)
+		hi = n;
+	sum->lo = v[lo - 1];
+	sum->hi = v[hi - 1];
+
+	for (i = 0; i < n; i++)
+		v[i] = fabs(v[i] - sum->median);
+	qsort(v, n, sizeof(*v), dcmp);
+
+	sum->mad = median(v, n);
+
+	free(v);
+}
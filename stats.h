@@ -0,0 +1,20 @@
+
+/*
+ * summary statistics for repeated runs.
+ *
+ * the median and median absolute deviation are used instead of the
+ * mean and standard deviation because benchmark results tend to have
+ * long tails. the confidence interval is for the median, and is
+ * worked out from the order statistics so it doesn't assume the
+ * results are normally distributed.
+ */
+
+struct summary {
+	size_t			 n;
+	double			 median;
+	double			 mad;
+	double			 lo;	/* 95% confidence interval */
+	double			 hi;
+};
+
+void	summarise(const double *, size_t, struct summary *);
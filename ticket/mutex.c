@@ -10,6 +10,7 @@
 
 #include <mutex.h>
 #include "../atomic.h"
+#include "../lockstat.h"
 
 void
 mtx_init(struct mutex *mtx)
@@ -28,8 +29,15 @@ void
 mtx_enter(struct mutex *mtx)
 {
 	unsigned int next = atomic_inc_int_nv(&mtx->next);
-	while (mtx->tick != next)
-		CPU_BUSY_CYCLE();
+	if (READ_ONCE(mtx->tick) == next)
+		LOCKSTAT_INC(LS_FAST);
+	else {
+		LOCKSTAT_INC(LS_PARK);
+		do {
+			CPU_BUSY_CYCLE();
+			LOCKSTAT_INC(LS_PARK_SPINS);
+		} while (READ_ONCE(mtx->tick) != next);
+	}
 	membar_enter();
 }
 
@@ -37,5 +45,5 @@ void
 mtx_leave(struct mutex *mtx)
 {
 	membar_exit();
-	mtx->tick++;
+	WRITE_ONCE(mtx->tick, mtx->tick + 1);
 }
@@ -0,0 +1,272 @@
+#!/usr/bin/env python3
+#
+# compare two sets of results from the mutex harness and report which
+# differences are statistically significant.
+#
+# each set is one or more files holding the json lines printed by test
+# (single runs or sweep summaries), the archive kept by results.py, or
+# the json exported by the hyperfine target. samples are matched
+# between the sets by lock, work, nthreads, and the loops or seconds
+# and noise they ran with, and compared with a Mann-Whitney U test,
+# which doesn't assume the numbers are normally distributed. run times
+# from a busy machine usually aren't.
+
+import argparse
+import json
+import math
+import sys
+
+from samples import records, runs, setting
+
+# metric, where to find it, and whether bigger numbers are better
+METRICS = [
+    ("ops_per_sec", True),
+    ("time", False),
+    ("wait_p99", False),
+    ("hold_p99", False),
+    ("handoff_p99", False),
+    ("cpu_per_mop", False),
+]
+
+
+def from_run(obj):
+    m = {}
+
+    for name in ("ops_per_sec", "time", "cpu_per_mop", "wait_p99"):
+        if name in obj:
+            m[name] = runs(obj[name])
+    for name in ("wait", "hold", "handoff"):
+        if isinstance(obj.get(name), dict) and "p99" in obj[name]:
+            m[name + "_p99"] = [obj[name]["p99"]]
+
+    key = (obj["lock"], obj.get("work", "inc"), int(obj["nthreads"]),
+           setting(obj))
+    return key, m
+
+
+def load(paths):
+    samples = {}
+
+    def add(key, m):
+        s = samples.setdefault(key, {})
+        for name, v in m.items():
+            s.setdefault(name, []).extend(float(x) for x in v
+                                          if x is not None)
+
+    for path in paths:
+        with open(path) as f:
+            for obj in records(f.read(), path):
+                add(*from_run(obj))
+
+    return samples
+
+
+def median(v):
+    v = sorted(v)
+    n = len(v)
+    if n % 2:
+        return v[n // 2]
+    return (v[n // 2 - 1] + v[n // 2]) / 2
+
+
+def ranks(values):
+    # average ranks, so ties share a rank
+    order = sorted(range(len(values)), key=lambda i: values[i])
+    r = [0.0] * len(values)
+    ties = []
+    i = 0
+    while i < len(order):
+        j = i
+        while j + 1 < len(order) and \
+                values[order[j + 1]] == values[order[i]]:
+            j += 1
+        for k in range(i, j + 1):
+            r[order[k]] = (i + j) / 2 + 1
+        if j > i:
+            ties.append(j - i + 1)
+        i = j + 1
+    return r, ties
+
+
+def u_exact(u, n1, n2):
+    # the distribution of U without ties, counted by the number of
+    # ways to get each value from n1 and n2 samples
+    counts = {}
+
+    def ways(k, a, b):
+        if k < 0:
+            return 0
+        if a == 0 or b == 0:
+            return 1 if k == 0 else 0
+        key = (k, a, b)
+        if key not in counts:
+            counts[key] = ways(k - b, a - 1, b) + ways(k, a, b - 1)
+        return counts[key]
+
+    total = math.comb(n1 + n2, n1)
+    lo = min(u, n1 * n2 - u)
+    p = sum(ways(k, n1, n2) for k in range(int(lo) + 1)) / total
+    return min(1.0, 2 * p)
+
+
+def mann_whitney(a, b):
+    n1, n2 = len(a), len(b)
+    r, ties = ranks(a + b)
+    u = sum(r[:n1]) - n1 * (n1 + 1) / 2
+
+    if not ties and n1 * n2 <= 400:
+        return u, u_exact(u, n1, n2)
+
+    n = n1 + n2
+    mu = n1 * n2 / 2
+    tie = sum(t ** 3 - t for t in ties) / (n * (n - 1))
+    sigma = math.sqrt(n1 * n2 / 12 * ((n + 1) - tie))
+    if sigma == 0:
+        return u, 1.0
+    # continuity correction
+    z = (abs(u - mu) - 0.5) / sigma
+    return u, min(1.0, math.erfc(max(z, 0) / math.sqrt(2)))
+
+
+def cliffs_delta(a, b):
+    # how often a value from b beats one from a, minus the reverse
+    gt = lt = 0
+    for x in a:
+        for y in b:
+            if y > x:
+                gt += 1
+            elif y < x:
+                lt += 1
+    return (gt - lt) / (len(a) * len(b))
+
+
+def holm(pvalues):
+    # Holm-Bonferroni adjusted p values, because lots of comparisons
+    # will find something "significant" by chance
+    order = sorted(range(len(pvalues)), key=lambda i: pvalues[i])
+    adj = [0.0] * len(pvalues)
+    m = len(pvalues)
+    running = 0.0
+    for rank, i in enumerate(order):
+        running = max(running, min(1.0, (m - rank) * pvalues[i]))
+        adj[i] = running
+    return adj
+
+
+def magnitude(d):
+    # thresholds from Romano et al, 2006
+    d = abs(d)
+    if d < 0.147:
+        return "negligible"
+    if d < 0.33:
+        return "small"
+    if d < 0.474:
+        return "medium"
+    return "large"
+
+
+def compare(base, cand, args):
+    rows = []
+
+    for key in sorted(set(base) & set(cand)):
+        for name, bigger in METRICS:
+            if args.metric and name not in args.metric:
+                continue
+            a = base[key].get(name)
+            b = cand[key].get(name)
+            if not a or not b:
+                continue
+
+            u, p = mann_whitney(a, b)
+            d = cliffs_delta(a, b)
+            ma, mb = median(a), median(b)
+            rows.append({
+                "lock": key[0], "work": key[1], "nthreads": key[2],
+                "setting": key[3], "metric": name, "n": [len(a), len(b)],
+                "median": [ma, mb],
+                "change": (mb - ma) / ma if ma else None,
+                "u": u, "p": p, "cliffs_delta": d,
+                "effect": magnitude(d),
+                "better": (d > 0) == bigger,
+            })
+
+    for row, p in zip(rows, holm([r["p"] for r in rows])):
+        row["p_adj"] = p
+        if p >= args.alpha or abs(row["cliffs_delta"]) < args.effect:
+            row["verdict"] = "same"
+        elif row["better"]:
+            row["verdict"] = "improvement"
+        else:
+            row["verdict"] = "regression"
+        del row["better"]
+
+    return rows
+
+
+def print_table(rows, out):
+    fmt = "%-16s %-12s %4s %-12s %5s %12s %12s %8s %8s %7s %-10s %-11s %s"
+    print(fmt % ("lock", "work", "n", "metric", "runs", "base", "new",
+                 "change", "p_adj", "delta", "effect", "verdict",
+                 "setting"), file=out)
+    for r in rows:
+        change = "-" if r["change"] is None else "%+.1f%%" % \
+            (r["change"] * 100)
+        print(fmt % (r["lock"], r["work"], r["nthreads"], r["metric"],
+                     "%d/%d" % tuple(r["n"]),
+                     "%.4g" % r["median"][0], "%.4g" % r["median"][1],
+                     change, "%.3g" % r["p_adj"],
+                     "%+.2f" % r["cliffs_delta"], r["effect"],
+                     r["verdict"], r["setting"]), file=out)
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description="compare two sets of mutex harness results")
+    ap.add_argument("-a", "--alpha", type=float, default=0.05,
+                    help="significance level after correction "
+                         "(default %(default)s)")
+    ap.add_argument("-e", "--effect", type=float, default=0.33,
+                    help="smallest |Cliff's delta| worth reporting "
+                         "(default %(default)s)")
+    ap.add_argument("-j", "--json", action="store_true",
+                    help="print the comparisons as json lines")
+    ap.add_argument("-m", "--metric", action="append",
+                    choices=[m for m, _ in METRICS],
+                    help="only compare this metric, can be repeated")
+    ap.add_argument("-b", "--base", nargs="+", required=True,
+                    metavar="FILE", help="baseline results")
+    ap.add_argument("-n", "--new", nargs="+", required=True,
+                    metavar="FILE", help="candidate results")
+    args = ap.parse_args()
+
+    base = load(args.base)
+    cand = load(args.new)
+
+    missing = set(base) ^ set(cand)
+    for key in sorted(missing):
+        print("%s/%s/%d (%s): only in %s" % (key + (
+            "baseline" if key in base else "candidate",)),
+            file=sys.stderr)
+
+    rows = compare(base, cand, args)
+    if not rows:
+        sys.exit("no matching results to compare")
+
+    for r in rows:
+        if min(r["n"]) < 5:
+            print("warning: fewer than 5 runs in some comparisons, "
+                  "the test can't find small differences",
+                  file=sys.stderr)
+            break
+
+    if args.json:
+        for r in rows:
+            print(json.dumps(r))
+    else:
+        print_table(rows, sys.stdout)
+
+    sys.exit(1 if any(r["verdict"] == "regression" for r in rows) else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,452 @@
+#!/usr/bin/env python3
+#
+# keep an archive of results from the mutex harness, and turn it into
+# a report.
+#
+# "add" reads the json lines printed by test (or a hyperfine export)
+# and appends one record per result to the archive, which is a json
+# lines file too. every record is tagged with where it came from: the
+# git commit, the compiler flags, and the cpu it ran on.
+#
+# "report" writes a single html file with inline svg charts of what's
+# in the archive, so it can be mailed around or opened from disk
+# without anything else.
+
+import argparse
+import html
+import json
+import math
+import os
+import platform
+import re
+import subprocess
+import sys
+import time
+
+from samples import records, runs, setting
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+ARCHIVE = os.path.join(ROOT, "results.jsonl")
+
+COLOURS = ["#1f77b4", "#ff7f0e", "#2ca02c", "#d62728", "#9467bd",
+           "#8c564b", "#e377c2", "#7f7f7f", "#bcbd22", "#17becf"]
+
+
+def run(*argv, cwd=ROOT):
+    try:
+        p = subprocess.run(argv, cwd=cwd, capture_output=True, text=True)
+    except OSError:
+        return None
+    if p.returncode != 0:
+        return None
+    return p.stdout.strip()
+
+
+def cpu_model():
+    try:
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                k, _, v = line.partition(":")
+                if k.strip() in ("model name", "Model", "cpu model"):
+                    return v.strip()
+    except OSError:
+        pass
+    for mib in ("hw.model", "machdep.cpu.brand_string"):
+        m = run("sysctl", "-n", mib)
+        if m:
+            return m
+    return platform.processor() or platform.machine()
+
+
+def cflags(lock):
+    # the gnu make build writes down what each test was built with.
+    # otherwise ask bsd make, and fall back to the environment
+    m = None
+    if lock is not None and os.path.isdir(os.path.join(ROOT, lock)):
+        try:
+            with open(os.path.join(ROOT, lock, "obj", "cflags")) as f:
+                m = f.read().strip()
+        except OSError:
+            m = run("make", "-V", "CFLAGS", cwd=os.path.join(ROOT, lock))
+    if m is None:
+        m = os.environ.get("CFLAGS", "")
+    return m
+
+
+def meta(args):
+    commit = run("git", "rev-parse", "HEAD")
+    if commit is not None and run("git", "status", "--porcelain",
+                                  "--untracked-files=no"):
+        commit += "-dirty"
+
+    return {
+        "date": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+        "host": platform.node(),
+        "os": "%s %s" % (platform.system(), platform.release()),
+        "commit": args.commit or commit,
+        "cpu": cpu_model(),
+        "ncpus": os.cpu_count(),
+        "tag": args.tag,
+    }
+
+
+def add(args):
+    inputs = [open(p) for p in args.files] or [sys.stdin]
+    cache = {}
+    n = 0
+
+    m = meta(args)
+    with open(args.archive, "a") as out:
+        for f in inputs:
+            for r in records(f.read(), f.name):
+                lock = r["lock"]
+                if args.cflags is not None:
+                    flags = args.cflags
+                elif lock not in cache:
+                    flags = cache[lock] = cflags(lock)
+                else:
+                    flags = cache[lock]
+                out.write(json.dumps({"meta": dict(m, cflags=flags),
+                                      "result": r}) + "\n")
+                n += 1
+
+    print("added %d records to %s" % (n, args.archive), file=sys.stderr)
+
+
+def load(args):
+    recs = []
+    with open(args.archive) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            r = json.loads(line)
+            commit = r["meta"].get("commit") or ""
+            if args.commit and not commit.startswith(args.commit):
+                continue
+            if args.tag and r["meta"].get("tag") != args.tag:
+                continue
+            recs.append(r)
+    return recs
+
+
+def locks_from_makefile():
+    try:
+        with open(os.path.join(ROOT, "Makefile")) as f:
+            for line in f:
+                m = re.match(r"^LOCKS\??=(.*)$", line.strip())
+                if m:
+                    return m[1].split(",")
+    except OSError:
+        pass
+    return None
+
+
+def median(v):
+    v = sorted(v)
+    n = len(v)
+    if n == 0:
+        return None
+    if n % 2:
+        return v[n // 2]
+    return (v[n // 2 - 1] + v[n // 2]) / 2
+
+
+# charts
+
+class Scale:
+    def __init__(self, lo, hi, a, b, log=False):
+        if log:
+            lo = 10 ** math.floor(math.log10(lo))
+            hi = 10 ** math.ceil(math.log10(hi))
+        elif lo == hi:
+            hi = lo + 1
+        self.lo, self.hi, self.a, self.b, self.log = lo, hi, a, b, log
+
+    def __call__(self, v):
+        if self.log:
+            f = (math.log10(v) - math.log10(self.lo)) / \
+                (math.log10(self.hi) - math.log10(self.lo))
+        else:
+            f = (v - self.lo) / (self.hi - self.lo)
+        return self.a + f * (self.b - self.a)
+
+    def ticks(self):
+        if self.log:
+            e = int(math.log10(self.lo))
+            while 10 ** e <= self.hi:
+                yield 10 ** e
+                e += 1
+            return
+        step = 10 ** math.floor(math.log10((self.hi - self.lo) / 5))
+        for m in (1, 2, 5, 10):
+            if (self.hi - self.lo) / (step * m) <= 6:
+                step *= m
+                break
+        t = math.ceil(self.lo / step) * step
+        while t <= self.hi + step / 1000:
+            yield t
+            t += step
+
+
+def fmt(v):
+    for div, suffix in ((1e9, "G"), (1e6, "M"), (1e3, "k")):
+        if abs(v) >= div:
+            return "%g%s" % (round(v / div, 2), suffix)
+    return "%g" % round(v, 3)
+
+
+W, H = 640, 360
+L, R, T, B = 70, 150, 30, 50
+
+
+def svg_open(title, xlabel, ylabel):
+    e = html.escape
+    return [
+        '<svg xmlns="http://www.w3.org/2000/svg" width="%d" height="%d" '
+        'font-family="sans-serif" font-size="11">' % (W, H),
+        '<text x="%d" y="18" font-size="13" font-weight="bold">%s</text>'
+        % (L, e(title)),
+        '<text x="%d" y="%d" text-anchor="middle">%s</text>'
+        % ((L + W - R) / 2, H - 10, e(xlabel)),
+        '<text transform="translate(14,%d) rotate(-90)" '
+        'text-anchor="middle">%s</text>' % ((T + H - B) / 2, e(ylabel)),
+    ]
+
+
+def svg_axes(xs, ys, xticks=None):
+    out = ['<rect x="%d" y="%d" width="%d" height="%d" fill="none" '
+           'stroke="#888"/>' % (L, T, W - R - L, H - B - T)]
+    for t in (xticks if xticks is not None else xs.ticks()):
+        x = xs(t)
+        out.append('<line x1="%.1f" x2="%.1f" y1="%d" y2="%d" '
+                   'stroke="#888"/>' % (x, x, H - B, H - B + 4))
+        out.append('<text x="%.1f" y="%d" text-anchor="middle">%s</text>'
+                   % (x, H - B + 16, fmt(t)))
+    for t in ys.ticks():
+        y = ys(t)
+        out.append('<line x1="%d" x2="%d" y1="%.1f" y2="%.1f" '
+                   'stroke="#eee"/>' % (L, W - R, y, y))
+        out.append('<text x="%d" y="%.1f" text-anchor="end">%s</text>'
+                   % (L - 6, y + 4, fmt(t)))
+    return out
+
+
+def svg_legend(names):
+    out = []
+    for i, name in enumerate(names):
+        y = T + 10 + i * 16
+        out.append('<rect x="%d" y="%d" width="10" height="10" fill="%s"/>'
+                   % (W - R + 12, y - 9, COLOURS[i % len(COLOURS)]))
+        out.append('<text x="%d" y="%d">%s</text>'
+                   % (W - R + 26, y, html.escape(name)))
+    return out
+
+
+def line_chart(title, xlabel, ylabel, series):
+    # series is {name: {x: y}}
+    xv = [x for s in series.values() for x in s]
+    yv = [y for s in series.values() for y in s.values()]
+    xs = Scale(min(xv), max(xv), L, W - R)
+    ys = Scale(0, max(yv) * 1.05, H - B, T)
+
+    out = svg_open(title, xlabel, ylabel)
+    out += svg_axes(xs, ys, sorted(set(xv)))
+    for i, (name, s) in enumerate(series.items()):
+        c = COLOURS[i % len(COLOURS)]
+        pts = " ".join("%.1f,%.1f" % (xs(x), ys(s[x])) for x in sorted(s))
+        out.append('<polyline fill="none" stroke="%s" stroke-width="2" '
+                   'points="%s"/>' % (c, pts))
+        for x in sorted(s):
+            out.append('<circle cx="%.1f" cy="%.1f" r="3" fill="%s">'
+                       '<title>%s: %s threads, %s</title></circle>'
+                       % (xs(x), ys(s[x]), c, html.escape(name), x,
+                          fmt(s[x])))
+    out += svg_legend(list(series))
+    out.append("</svg>")
+    return "\n".join(out)
+
+
+def bar_chart(title, ylabel, groups, bars):
+    # groups is {name: {bar: value}}, drawn on a log scale
+    yv = [v for g in groups.values() for v in g.values()
+          if v is not None and v > 0]
+    if not yv:
+        return ""
+    ys = Scale(min(yv), max(yv), H - B, T, log=True)
+    gw = (W - R - L) / len(groups)
+    bw = gw * 0.8 / len(bars)
+
+    out = svg_open(title, "", ylabel)
+    out += svg_axes(Scale(0, 1, L, W - R), ys, [])
+    for gi, (name, g) in enumerate(groups.items()):
+        x0 = L + gi * gw + gw * 0.1
+        out.append('<text x="%.1f" y="%d" text-anchor="middle">%s</text>'
+                   % (x0 + gw * 0.4, H - B + 16, html.escape(name)))
+        for bi, bar in enumerate(bars):
+            v = g.get(bar)
+            if not v:
+                continue
+            y = ys(v)
+            out.append('<rect x="%.1f" y="%.1f" width="%.1f" height="%.1f" '
+                       'fill="%s"><title>%s %s: %sns</title></rect>'
+                       % (x0 + bi * bw, y, bw, H - B - y,
+                          COLOURS[bi % len(COLOURS)], html.escape(name),
+                          bar, fmt(v)))
+    out += svg_legend(bars)
+    out.append("</svg>")
+    return "\n".join(out)
+
+
+def scatter_chart(title, xlabel, ylabel, series):
+    # series is {name: [(x, y, label)]}
+    xv = [p[0] for s in series.values() for p in s]
+    yv = [p[1] for s in series.values() for p in s]
+    xs = Scale(0, max(xv) * 1.05, L, W - R)
+    ys = Scale(min(0.5, min(yv)), 1.0, H - B, T)
+
+    out = svg_open(title, xlabel, ylabel)
+    out += svg_axes(xs, ys)
+    for i, (name, s) in enumerate(series.items()):
+        c = COLOURS[i % len(COLOURS)]
+        for x, y, label in s:
+            out.append('<circle cx="%.1f" cy="%.1f" r="4" fill="%s" '
+                       'fill-opacity="0.7"><title>%s %s: %s ops/s, '
+                       'jain %.3f</title></circle>'
+                       % (xs(x), ys(y), c, html.escape(name),
+                          html.escape(label), fmt(x), y))
+    out += svg_legend(list(series))
+    out.append("</svg>")
+    return "\n".join(out)
+
+
+PERCENTILES = ["p50", "p90", "p99", "p99.9"]
+
+
+def report(args):
+    recs = load(args)
+    if not recs:
+        sys.exit("%s: no records" % args.archive)
+
+    locks = args.locks.split(",") if args.locks else locks_from_makefile()
+
+    # ops/sec per work and setting, lock, and nthreads. runs with
+    # different loops, seconds, or noise don't go on the same chart
+    tput = {}
+    # wait percentiles from runs with -H at the most threads
+    lat = {}
+    # fairness against throughput
+    fair = {}
+
+    for rec in recs:
+        r = rec["result"]
+        lock, work, n = r["lock"], r.get("work", "inc"), r["nthreads"]
+        how = setting(r)
+        chart = "%s, %s" % (work, how) if how else work
+
+        if "ops_per_sec" in r:
+            tput.setdefault(chart, {}).setdefault(lock, {}) \
+                .setdefault(n, []).extend(runs(r["ops_per_sec"]))
+
+        if isinstance(r.get("wait"), dict):
+            cur = lat.setdefault(chart, {}).get(lock)
+            if cur is None or n > cur[0]:
+                lat[chart][lock] = (n, [])
+                cur = lat[chart][lock]
+            if n == cur[0]:
+                cur[1].append(r["wait"])
+
+        if "fairness" in r and "ops_per_sec" in r and \
+                (locks is None or lock in locks):
+            fair.setdefault(lock, []).append(
+                (r["ops_per_sec"], r["fairness"]["jain"],
+                 "%s/%d" % (chart, n)))
+
+    charts = []
+    for chart in sorted(tput):
+        series = {lock: {n: median(v) for n, v in s.items()}
+                  for lock, s in sorted(tput[chart].items())}
+        charts.append(("Throughput: %s" % chart, line_chart(
+            "throughput, %s" % chart, "threads", "ops/sec", series)))
+
+    for chart in sorted(lat):
+        groups = {}
+        for lock, (n, waits) in sorted(lat[chart].items()):
+            groups["%s (%d)" % (lock, n)] = {
+                p: median([w[p] for w in waits if p in w])
+                for p in PERCENTILES}
+        charts.append(("Wait latency: %s" % chart, bar_chart(
+            "wait for the lock, %s" % chart, "ns", groups, PERCENTILES)))
+
+    if fair:
+        charts.append(("Fairness vs throughput", scatter_chart(
+            "fairness vs throughput", "ops/sec", "Jain's index",
+            dict(sorted(fair.items())))))
+
+    metas = {}
+    for rec in recs:
+        m = rec["meta"]
+        key = (m.get("commit"), m.get("cpu"), m.get("ncpus"),
+               m.get("cflags"), m.get("tag"))
+        metas[key] = metas.get(key, 0) + 1
+
+    e = html.escape
+    out = ["<!DOCTYPE html>", "<html><head><meta charset=\"utf-8\">",
+           "<title>mutex results</title>",
+           "<style>body{font-family:sans-serif;margin:2em}"
+           "table{border-collapse:collapse}"
+           "td,th{border:1px solid #ccc;padding:2px 8px;text-align:left}"
+           "</style></head><body>",
+           "<h1>mutex results</h1>",
+           "<p>%d records from %s</p>" % (len(recs), e(args.archive)),
+           "<table><tr><th>commit</th><th>cpu</th><th>ncpus</th>"
+           "<th>cflags</th><th>tag</th><th>records</th></tr>"]
+    for key, n in sorted(metas.items(), key=lambda kv: str(kv[0])):
+        out.append("<tr>%s<td>%d</td></tr>" % (
+            "".join("<td>%s</td>" % e(str(v) if v is not None else "")
+                    for v in key), n))
+    out.append("</table>")
+    if not lat:
+        out.append("<p>no latency percentiles, use -H to record them</p>")
+    for title, svg in charts:
+        out.append("<h2>%s</h2>" % e(title))
+        out.append(svg)
+    out.append("</body></html>")
+
+    with open(args.output, "w") as f:
+        f.write("\n".join(out) + "\n")
+    print("wrote %s" % args.output, file=sys.stderr)
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description="archive and report mutex harness results")
+    ap.add_argument("-f", "--archive", default=ARCHIVE,
+                    help="archive file (default %(default)s)")
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    a = sub.add_parser("add", help="add results to the archive")
+    a.add_argument("-c", "--commit", help="commit the results are from, "
+                   "instead of the checked out one")
+    a.add_argument("-F", "--cflags", help="compiler flags, instead of "
+                   "asking make")
+    a.add_argument("-t", "--tag", help="free form label for the records")
+    a.add_argument("files", nargs="*", help="results, or stdin")
+    a.set_defaults(func=add)
+
+    r = sub.add_parser("report", help="write an html report")
+    r.add_argument("-c", "--commit", help="only use records from commits "
+                   "starting with this")
+    r.add_argument("-t", "--tag", help="only use records with this tag")
+    r.add_argument("-L", "--locks", help="locks to compare fairness of, "
+                   "LOCKS from the Makefile by default")
+    r.add_argument("-o", "--output", default="report.html",
+                   help="html file (default %(default)s)")
+    r.set_defaults(func=report)
+
+    args = ap.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
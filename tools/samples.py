@@ -0,0 +1,78 @@
+# reading results from the mutex harness, shared by the tools.
+#
+# results come as the json lines printed by test (single runs or
+# sweep summaries), the archive written by results.py, which wraps
+# each line in a record with some metadata, or the json exported by
+# the hyperfine target.
+
+import json
+import re
+
+# hyperfine names each command "{LOCK} -n N -l L -w {WORK}"
+HYPERFINE_NAME = re.compile(
+    r"^(?P<lock>\S+) -n (?P<nthreads>\d+) -l (?P<loops>\d+) -w (?P<work>\S+)$")
+
+
+def runs(v):
+    # sweep lines summarise each metric and list every run
+    if isinstance(v, dict):
+        return v.get("runs", [v.get("median")])
+    return [v]
+
+
+def setting(obj):
+    # how a run was made besides the lock, work, and thread count, as
+    # the options that made it. runs that differ here mustn't be
+    # compared or fitted together
+    opts = []
+    if obj.get("seconds"):
+        opts.append("-t %d" % obj["seconds"])
+    elif "loops" in obj:
+        opts.append("-l %d" % obj["loops"])
+    noise = obj.get("noise")
+    if isinstance(noise, dict):
+        spec = "%s=%d,n=%d,duty=%d" % (noise["kind"], noise["mb"],
+                                       noise["nthreads"], noise["duty"])
+        if "cpus" in noise:
+            spec += ",on=" + ",".join(str(c) for c in noise["cpus"])
+        opts.append("-N " + spec)
+    return " ".join(opts)
+
+
+def hyperfine(obj):
+    # each timing is a run of every thread doing its loops
+    for r in obj["results"]:
+        match = HYPERFINE_NAME.match(r.get("command", ""))
+        if match is None:
+            continue
+        nthreads = int(match["nthreads"])
+        loops = int(match["loops"])
+        for t in r.get("times", []):
+            yield {"lock": match["lock"], "work": match["work"],
+                   "loops": loops, "nthreads": nthreads, "time": t,
+                   "ops_per_sec": loops * nthreads / t}
+
+
+def records(text, name="-"):
+    # yield every result for a lock and thread count, skipping the
+    # -M matrices and anything else that isn't one
+    try:
+        obj = json.loads(text)
+    except json.JSONDecodeError:
+        obj = None
+
+    if isinstance(obj, dict) and "results" in obj:
+        yield from hyperfine(obj)
+        return
+
+    for n, line in enumerate(text.splitlines(), 1):
+        line = line.strip()
+        if not line.startswith("{"):
+            continue
+        try:
+            obj = json.loads(line)
+        except json.JSONDecodeError as e:
+            raise SystemExit("%s:%d: %s" % (name, n, e))
+        obj = obj.get("result", obj)
+        if "lock" in obj and "nthreads" in obj and "matrix" not in obj:
+            yield obj
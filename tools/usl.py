@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+#
+# fit results from thread count sweeps to the Universal Scalability
+# Law:
+#
+#                    lambda * N
+#   X(N) = -------------------------------
+#          1 + sigma * (N - 1) + kappa * N * (N - 1)
+#
+# where X is throughput with N threads, lambda is the throughput of a
+# single thread, sigma is the cost of contention (the part of the work
+# that's serialised, ie, waiting for the lock), and kappa is the cost
+# of coherency (every thread having to see what every other thread
+# did, ie, the lock cacheline bouncing between CPUs). with kappa > 0
+# the throughput peaks at N = sqrt((1 - sigma) / kappa) and falls
+# after that.
+#
+# it reads test output, including sweeps, the archive written by
+# results.py, or hyperfine exports, eg:
+#
+#   $ make bench | ./tools/usl.py
+#   $ ./parking/obj/test -n 1-16 -r 5 | ./tools/usl.py -p 64,128
+
+import argparse
+import json
+import math
+import sys
+
+from samples import records, runs, setting
+
+def samples(f):
+    for r in records(f.read(), f.name):
+        if "ops_per_sec" not in r:
+            continue
+        for v in runs(r["ops_per_sec"]):
+            yield (r["lock"], r.get("work", "inc"), setting(r),
+                   int(r["nthreads"]), v)
+
+
+def usl(n, lam, sigma, kappa):
+    return lam * n / (1 + sigma * (n - 1) + kappa * n * (n - 1))
+
+
+def solve3(a, b):
+    # gaussian elimination with partial pivoting for the 3x3 normal
+    # equations
+    m = [row[:] + [v] for row, v in zip(a, b)]
+    for c in range(3):
+        p = max(range(c, 3), key=lambda r: abs(m[r][c]))
+        if abs(m[p][c]) < 1e-300:
+            return None
+        m[c], m[p] = m[p], m[c]
+        for r in range(3):
+            if r != c:
+                f = m[r][c] / m[c][c]
+                for k in range(c, 4):
+                    m[r][k] -= f * m[c][k]
+    return [m[i][3] / m[i][i] for i in range(3)]
+
+
+def sse(pts, p):
+    return sum((x - usl(n, *p)) ** 2 for n, x in pts)
+
+
+def fit(pts):
+    # start from the linearised model. with C(N) = X(N) / lambda,
+    # N / C(N) - 1 = sigma * (N - 1) + kappa * N * (N - 1), which is
+    # linear in sigma and kappa.
+    ones = [x for n, x in pts if n == 1]
+    lam = sum(ones) / len(ones) if ones else max(x / n for n, x in pts)
+
+    sxx = sxy = syy = sx = sy = 0.0
+    for n, x in pts:
+        if n == 1:
+            continue
+        a, b = n - 1, n * (n - 1)
+        z = n * lam / x - 1
+        sxx += a * a
+        sxy += a * b
+        syy += b * b
+        sx += a * z
+        sy += b * z
+    det = sxx * syy - sxy * sxy
+    if det > 0:
+        sigma = (sx * syy - sy * sxy) / det
+        kappa = (sy * sxx - sx * sxy) / det
+    else:
+        sigma, kappa = 0.0, 0.0
+    p = [lam, min(max(sigma, 0.0), 1.0), max(kappa, 0.0)]
+
+    # then refine all three with Levenberg-Marquardt, keeping sigma
+    # and kappa where they make sense
+    mu = 1e-3
+    cur = sse(pts, p)
+    for _ in range(200):
+        jtj = [[0.0] * 3 for _ in range(3)]
+        jtr = [0.0] * 3
+        for n, x in pts:
+            d = 1 + p[1] * (n - 1) + p[2] * n * (n - 1)
+            y = p[0] * n / d
+            j = [n / d, -y * (n - 1) / d, -y * n * (n - 1) / d]
+            r = x - y
+            for i in range(3):
+                jtr[i] += j[i] * r
+                for k in range(3):
+                    jtj[i][k] += j[i] * j[k]
+
+        while mu < 1e12:
+            a = [[jtj[i][k] * (1 + mu if i == k else 1) for k in range(3)]
+                 for i in range(3)]
+            step = solve3(a, jtr)
+            if step is None:
+                mu *= 10
+                continue
+            q = [p[0] + step[0], min(max(p[1] + step[1], 0.0), 1.0),
+                 max(p[2] + step[2], 0.0)]
+            new = sse(pts, q)
+            if new < cur:
+                break
+            mu *= 10
+        else:
+            break
+
+        done = cur - new < cur * 1e-12
+        p, cur = q, new
+        mu = max(mu / 10, 1e-12)
+        if done:
+            break
+
+    mean = sum(x for _, x in pts) / len(pts)
+    sst = sum((x - mean) ** 2 for _, x in pts)
+    return {
+        "lambda": p[0],
+        "sigma": p[1],
+        "kappa": p[2],
+        "r2": 1 - cur / sst if sst > 0 else 1.0,
+        "rmse": math.sqrt(cur / len(pts)),
+    }
+
+
+def peak(f):
+    if f["kappa"] <= 0:
+        return None
+    return math.sqrt((1 - f["sigma"]) / f["kappa"])
+
+
+def limit(f):
+    # the most throughput the lock can give, which is where X(N)
+    # levels off with kappa == 0
+    n = peak(f)
+    if n is not None:
+        return usl(n, f["lambda"], f["sigma"], f["kappa"])
+    if f["sigma"] > 0:
+        return f["lambda"] / f["sigma"]
+    return None
+
+
+def diagnose(f, nmax):
+    # which of the two terms costs more at the biggest N we ran
+    s = f["sigma"] * (nmax - 1)
+    k = f["kappa"] * nmax * (nmax - 1)
+    if s + k < 0.05:
+        return "linear"
+    if s >= k:
+        return "contention"
+    return "coherency"
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description="fit thread count sweeps to the Universal "
+                    "Scalability Law")
+    ap.add_argument("-j", "--json", action="store_true",
+                    help="print the fits as json lines")
+    ap.add_argument("-p", "--predict", default="",
+                    help="comma separated thread counts to predict "
+                         "the throughput of")
+    ap.add_argument("files", nargs="*", help="results, or stdin")
+    args = ap.parse_args()
+
+    predict = [int(n) for n in args.predict.split(",") if n]
+
+    groups = {}
+    for f in [open(p) for p in args.files] or [sys.stdin]:
+        for lock, work, how, n, x in samples(f):
+            groups.setdefault((lock, work, how), []).append((n, x))
+
+    fits = []
+    for (lock, work, how), pts in sorted(groups.items()):
+        ns = sorted(set(n for n, _ in pts))
+        if len(ns) < 3:
+            print("%s/%s (%s): need at least 3 thread counts, have %d" %
+                  (lock, work, how, len(ns)), file=sys.stderr)
+            continue
+
+        f = fit(pts)
+        n = peak(f)
+        f.update({
+            "lock": lock,
+            "work": work,
+            "setting": how,
+            "nthreads": ns,
+            "points": len(pts),
+            "peak_nthreads": n,
+            "peak_ops_per_sec": limit(f),
+            "bottleneck": diagnose(f, ns[-1]),
+            "predict": {str(p): usl(p, f["lambda"], f["sigma"], f["kappa"])
+                        for p in predict},
+        })
+        fits.append(f)
+
+    if not fits:
+        sys.exit("nothing to fit")
+
+    if args.json:
+        for f in fits:
+            print(json.dumps(f))
+        return
+
+    hdr = "%-16s %-12s %7s %12s %9s %9s %8s %12s %6s %-10s" % (
+        "lock", "work", "threads", "lambda", "sigma", "kappa", "peak_n",
+        "peak_ops", "r2", "bottleneck")
+    for p in predict:
+        hdr += " %12s" % ("n=%d" % p)
+    hdr += " setting"
+    print(hdr)
+    for f in fits:
+        line = "%-16s %-12s %7s %12.4g %9.3g %9.3g %8s %12s %6.3f %-10s" % (
+            f["lock"], f["work"],
+            "%d-%d" % (f["nthreads"][0], f["nthreads"][-1]),
+            f["lambda"], f["sigma"], f["kappa"],
+            "-" if f["peak_nthreads"] is None else
+            "%.1f" % f["peak_nthreads"],
+            "-" if f["peak_ops_per_sec"] is None else
+            "%.4g" % f["peak_ops_per_sec"],
+            f["r2"], f["bottleneck"])
+        for p in predict:
+            line += " %12.4g" % f["predict"][str(p)]
+        print(line + " " + f["setting"])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,115 @@
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+__thread struct trace_ring *trace_ring;
+
+int
+trace_alloc(struct trace_ring *tr, unsigned int bits)
+{
+	size_t nevents = 1UL << bits;
+
+	tr->tr_events = calloc(nevents, sizeof(*tr->tr_events));
+	if (tr->tr_events == NULL)
+		return (-1);
+
+	tr->tr_mask = nevents - 1;
+	tr->tr_next = 0;
+
+	return (0);
+}
+
+/*
+ * write the events out in the chrome trace event json format, which
+ * can be loaded into ui.perfetto.dev or chrome://tracing.
+ *
+ * waiting for a mutex, holding a mutex, and being parked are turned
+ * into duration events so they show up as slices in the thread
+ * timelines. everything else is an instant event.
+ */
+
+struct trace_name {
+	const char		*name;
+	char			 ph;
+};
+
+static const struct trace_name trace_names[] = {
+	[TRACE_ENTER] =		{ "wait",	'B' },
+	[TRACE_ACQUIRED] =	{ "wait",	'E' },
+	[TRACE_RELEASE] =	{ "hold",	'E' },
+	[TRACE_PARK] =		{ "parked",	'B' },
+	[TRACE_UNPARK] =	{ "parked",	'E' },
+	[TRACE_BUCKET] =	{ "bucket",	'i' },
+	[TRACE_WAKE] =		{ "wake",	'i' },
+};
+
+static void
+trace_print(FILE *f, const char *name, char ph, double us, pid_t pid,
+    unsigned int tid, uint32_t arg)
+{
+	fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+	    "\"pid\":%d,\"tid\":%u", name, ph, us, pid, tid);
+	if (ph == 'i')
+		fprintf(f, ",\"s\":\"t\"");
+	fprintf(f, ",\"args\":{\"addr\":\"0x%08x\"}}", arg);
+}
+
+void
+trace_export_begin(FILE *f)
+{
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+	    "\"args\":{\"name\":\"%s\"}}", getpid(), getprogname());
+}
+
+void
+trace_export_thread(FILE *f, const struct trace_ring *tr, unsigned int tid,
+    uint64_t start, uint64_t hz)
+{
+	const struct trace_event *te;
+	const struct trace_name *tn;
+	uint64_t i, first = 0;
+	pid_t pid = getpid();
+	int skip = 0;
+	double us;
+
+	fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\","
+	    "\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+	    pid, tid, tid);
+
+	if (tr->tr_next > tr->tr_mask + 1) {
+		/* the ring wrapped, start at the oldest event */
+		first = tr->tr_next - (tr->tr_mask + 1);
+		skip = 1;
+	}
+
+	for (i = first; i < tr->tr_next; i++) {
+		te = &tr->tr_events[i & tr->tr_mask];
+
+		/* don't start with the end of a slice */
+		if (skip) {
+			if (te->te_type != TRACE_ENTER)
+				continue;
+			skip = 0;
+		}
+
+		us = (double)(te->te_ts - start) * 1000000.0 / hz;
+		tn = &trace_names[te->te_type];
+
+		trace_print(f, tn->name, tn->ph, us, pid, tid, te->te_arg);
+		if (te->te_type == TRACE_ACQUIRED)
+			trace_print(f, "hold", 'B', us, pid, tid, te->te_arg);
+	}
+}
+
+void
+trace_export_end(FILE *f)
+{
+	fprintf(f, "\n]}\n");
+}
@@ -0,0 +1,63 @@
+
+/*
+ * per-thread event tracing.
+ *
+ * each thread gets a preallocated ring of events that only it writes
+ * to, so recording an event is a couple of stores and a read of the
+ * cycle counter. if a thread records more events than fit in the
+ * ring, the oldest ones are overwritten.
+ *
+ * the harness points trace_ring at the current threads ring when
+ * tracing is enabled. the mutex implementations can call trace() to
+ * record what they're doing, which does nothing when tracing is off.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cycles.h"
+
+enum trace_type {
+	TRACE_ENTER,		/* mtx_enter called */
+	TRACE_ACQUIRED,		/* mtx_enter returned */
+	TRACE_RELEASE,		/* mtx_leave called */
+	TRACE_PARK,		/* started waiting in the parking lot */
+	TRACE_UNPARK,		/* woken up in the parking lot */
+	TRACE_BUCKET,		/* took a parking lot bucket lock */
+	TRACE_WAKE,		/* woke a waiter in mtx_leave */
+};
+
+struct trace_event {
+	uint64_t		 te_ts;
+	uint32_t		 te_type;
+	uint32_t		 te_arg;
+};
+
+struct trace_ring {
+	struct trace_event	*tr_events;
+	uint64_t		 tr_mask;
+	uint64_t		 tr_next;
+};
+
+extern __thread struct trace_ring *trace_ring;
+
+static inline void
+trace(enum trace_type type, const void *arg)
+{
+	struct trace_ring *tr = trace_ring;
+	struct trace_event *te;
+
+	if (__builtin_expect(tr == NULL, 1))
+		return;
+
+	te = &tr->tr_events[tr->tr_next++ & tr->tr_mask];
+	te->te_ts = cycles();
+	te->te_type = type;
+	te->te_arg = (uint32_t)(uintptr_t)arg;
+}
+
+int	trace_alloc(struct trace_ring *, unsigned int);
+void	trace_export_begin(FILE *);
+void	trace_export_thread(FILE *, const struct trace_ring *, unsigned int,
+	    uint64_t, uint64_t);
+void	trace_export_end(FILE *);
@@ -0,0 +1,377 @@
+/*
+ * the work loops, compiled against a mutex implementation so they
+ * call its mtx_enter and mtx_leave directly instead of through a
+ * function pointer.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <err.h>
+
+#include <pthread.h>
+
+#include <mutex.h>
+
+#include "atomic.h"
+#include "cycles.h"
+#include "harness.h"
+#include "delay.h"
+#include "intr.h"
+#include "spin.h"
+
+#define XSTR(S) #S
+#define STR(S) XSTR(S)
+
+#ifndef LOCKNAME
+#define LOCKNAME TESTNAME
+#endif
+
+#define MTX(_s)		((struct mutex *)(_s)->mtx)
+#define IMTX(_s)	((struct mutex *)(_s)->imtx)
+
+_Static_assert(sizeof(struct mutex) <= MTX_MAXSIZE,
+    "struct mutex doesn't fit in struct state");
+
+/*
+ * wrappers around mtx_enter and mtx_leave that optionally time how
+ * long it took to get the lock, and how long it was held for.
+ *
+ * they can also measure how long it takes to hand the lock over
+ * between threads. the releasing thread stores a timestamp next to
+ * the lock before releasing it, and the next thread to get the lock
+ * compares that to when it got the lock. only threads that were
+ * already waiting when the lock was released count, otherwise the
+ * time the lock sat idle would be counted too. this relies on the
+ * cycle counters on all cpus being synchronised, which is true of
+ * the invariant TSC on modern x86.
+ *
+ * the histograms are updated after the lock is released so the
+ * accounting doesn't extend the critical section.
+ *
+ * with -I interrupts are blocked while the lock is held, like a
+ * kernel mutex raising the ipl. the kernel does this before it takes
+ * the lock, and lowers it again while it spins, so blocking them just
+ * after mtx_enter returns is close.
+ *
+ * -D stalls the thread now and then while it holds the lock.
+ */
+
+static inline void
+lock_enter(struct tstate *ts, struct mutex *mtx)
+{
+	struct state *s;
+
+	if ((ts->flags & TS_INSTRUMENT) == 0) {
+		mtx_enter(mtx);
+		return;
+	}
+
+	ts->start = cycles();
+	trace(TRACE_ENTER, mtx);
+	mtx_enter(mtx);
+	ts->held = cycles();
+	if (ts->flags & TS_INTR)
+		ts->ipl = intr_disable();
+	trace(TRACE_ACQUIRED, mtx);
+
+	if ((ts->flags & TS_DELAY) && delay_hit(&ts->rng)) {
+		delay_run();
+		ts->delays++;
+	}
+
+	if (ts->flags & TS_HANDOFF) {
+		s = ts->state;
+		/* a lock released before we asked for it was idle */
+		if (s->releaser != ts->id && s->releaser != UINT_MAX &&
+		    s->released > ts->start)
+			ts->handoff = ts->held - s->released;
+	}
+}
+
+static inline void
+lock_leave(struct tstate *ts, struct mutex *mtx)
+{
+	struct state *s;
+	uint64_t released;
+
+	if ((ts->flags & TS_INSTRUMENT) == 0) {
+		mtx_leave(mtx);
+		ts->acquisitions++;
+		return;
+	}
+
+	released = cycles();
+	trace(TRACE_RELEASE, mtx);
+	if (ts->flags & TS_HANDOFF) {
+		s = ts->state;
+		s->releaser = ts->id;
+		s->released = released;
+	}
+	mtx_leave(mtx);
+	if (ts->flags & TS_INTR)
+		intr_restore(ts->ipl);
+	ts->acquisitions++;
+
+	if (ts->flags & TS_TIMING) {
+		hist_add(&ts->wait, ts->held - ts->start);
+		hist_add(&ts->hold, released - ts->held);
+	}
+	if (ts->handoff != UINT64_MAX) {
+		hist_add(&ts->handoffs, ts->handoff);
+		ts->handoff = UINT64_MAX;
+	}
+}
+
+/*
+ * work loops run until they've done their loops, or until the harness
+ * tells them to stop.
+ */
+
+static inline int
+work_next(struct tstate *ts)
+{
+	uint64_t ops = ts->ops;
+
+	if (ops >= ts->loops || READ_ONCE(ts->state->stop))
+		return (0);
+
+	WRITE_ONCE(ts->ops, ops + 1);
+
+	return (1);
+}
+
+static void
+work_inc(struct tstate *ts)
+{
+	struct state *s = ts->state;
+
+	while (work_next(ts)) {
+		lock_enter(ts, MTX(s));
+		s->v++;
+		lock_leave(ts, MTX(s));
+	}
+}
+
+static void
+check_inc(struct state *s)
+{
+	if (s->v != s->ops)
+		errx(1, "unexpected value %llu after workers finished", s->v);
+}
+
+static void
+work_inc_padded(struct tstate *ts)
+{
+	struct state *s = ts->state;
+
+	while (work_next(ts)) {
+		lock_enter(ts, MTX(s));
+		s->pv++;
+		lock_leave(ts, MTX(s));
+	}
+}
+
+static void
+check_inc_padded(struct state *s)
+{
+	if (s->pv != s->ops)
+		errx(1, "unexpected value %llu after workers finished", s->pv);
+}
+
+static void
+work_inc_wait(struct tstate *ts)
+{
+	struct state *s = ts->state;
+
+	while (work_next(ts)) {
+		lock_enter(ts, MTX(s));
+		s->v++;
+		spin_wait(spin_counts[SPIN_WORK]);
+		lock_leave(ts, MTX(s));
+	}
+}
+
+static void
+work_inc_wait_wait(struct tstate *ts)
+{
+	struct state *s = ts->state;
+
+	while (work_next(ts)) {
+		lock_enter(ts, MTX(s));
+		s->v++;
+		spin_wait(spin_counts[SPIN_WORK]);
+		lock_leave(ts, MTX(s));
+		spin_wait(spin_counts[SPIN_WORK]);
+	}
+}
+
+static void
+work_inc_unbalanced(struct tstate *ts)
+{
+	struct state *s = ts->state;
+	int slow = (ts->id == 0);
+
+	while (work_next(ts)) {
+		lock_enter(ts, MTX(s));
+		s->v++;
+		if (slow)
+			spin_wait(spin_counts[SPIN_WORK]);
+		lock_leave(ts, MTX(s));
+	}
+}
+
+/*
+ * access to a "resource" is protected by a mutex.
+ *
+ * threads coordinate via a mutex to take ownership of a "resource",
+ * which they then operate on outside the mutex, before taking the
+ * mutex again to return it.
+ */
+
+static void
+work_inc_res(struct tstate *ts)
+{
+	struct state *s = ts->state;
+	uint64_t v;
+
+	while (work_next(ts)) {
+		do {
+			lock_enter(ts, MTX(s));
+			v = s->v;
+			if (v == 0)
+				s->v = 1;
+			lock_leave(ts, MTX(s));
+		} while (v != 0);
+
+		s->pv++;
+
+		lock_enter(ts, MTX(s));
+		s->v = 0;
+		lock_leave(ts, MTX(s));
+	}
+}
+
+/*
+ * arc4random takes 4 bytes at a time from a cryptographic stream cipher.
+ * the stream cipher produces a lot more than 4 bytes at a time, so the
+ * runtime of individual arc4random calls can vary. they're either short
+ * or long.
+ */
+
+static void
+work_arc4random(struct tstate *ts)
+{
+	struct state *s = ts->state;
+	uint64_t v;
+
+	while (work_next(ts)) {
+		lock_enter(ts, MTX(s));
+		arc4random();
+		lock_leave(ts, MTX(s));
+	}
+}
+
+/*
+ * use the result of arc4random as a delay time before attempting
+ * to retake the lock.
+ */
+
+static void
+work_arc4random_wait(struct tstate *ts)
+{
+	struct state *s = ts->state;
+	uint64_t v;
+	uint32_t w;
+
+	while (work_next(ts)) {
+		lock_enter(ts, MTX(s));
+		w = arc4random();
+		lock_leave(ts, MTX(s));
+
+		w &= 0xfff;
+
+		while (w > 0) {
+			CPU_BUSY_CYCLE();
+			w--;
+		}
+	}
+}
+
+static void
+check_arc4random(struct state *s)
+{
+	/* nop */
+}
+
+static const struct work workers[] = {
+	{ "inc",	work_inc,		 check_inc },
+	{ "inc-padded",	work_inc_padded,	 check_inc_padded },
+	{ "inc-wait",	work_inc_wait,		 check_inc },
+	{ "inc-wait-wait",
+			work_inc_wait_wait,	 check_inc },
+	{ "inc-unbalanced",
+			work_inc_unbalanced,	 check_inc },
+	{ "res",	work_inc_res,		 check_inc_padded },
+	{ "arc4random",	work_arc4random,	 check_arc4random },
+	{ "arc4random-wait",
+			work_arc4random_wait,	 check_arc4random },
+};
+
+/*
+ * -M lock takes turns with another thread at incrementing a counter
+ * under the mutex.
+ */
+
+static void
+pingpong_lock(void *mtx, volatile uint64_t *vp, unsigned int me,
+    uint64_t rounds)
+{
+	uint64_t n, v;
+
+	for (n = 0; n < rounds; n++) {
+		do {
+			mtx_enter(mtx);
+			v = *vp;
+			if ((v & 1) == me)
+				*vp = v + 1;
+			mtx_leave(mtx);
+		} while ((v & 1) != me);
+	}
+}
+
+/*
+ * -I runs this from a signal handler, like an interrupt handler
+ * taking a mutex of its own.
+ */
+
+static void
+intr_lock(struct tstate *ts)
+{
+	struct state *s = ts->state;
+
+	mtx_enter(IMTX(s));
+	s->intrs++;
+	mtx_leave(IMTX(s));
+}
+
+static void
+lock_init(void *mtx)
+{
+	mtx_init(mtx);
+}
+
+static const struct lock lock = {
+	.name =		STR(LOCKNAME),
+	.init =		lock_init,
+	.works =	workers,
+	.nworks =	sizeof(workers) / sizeof(workers[0]),
+	.pingpong =	pingpong_lock,
+	.intr =		intr_lock,
+};
+
+static void __attribute__((constructor))
+lock_ctor(void)
+{
+	lock_register(&lock);
+}
@@ -9,6 +9,10 @@
 
 #include <mutex.h>
 #include "../atomic.h"
+#include "../trace.h"
+#include "../lockstat.h"
+#include "../intr.h"
+#include "../spin.h"
 
 #include <machine/spinlock.h>
 #include <sys/queue.h>
@@ -18,9 +22,6 @@
 
 #define ISSET(_w, _m) ((_w) & (_m))
 
-#define intr_disable() (0)
-#define intr_restore(m) do { } while (0)
-
 struct cpu_info;
 
 #define curcpu() ((struct cpu_info *)1)
@@ -62,9 +63,13 @@ mtx_enter_park(struct mtx_park *p)
 	unsigned long m;
 
 	m = intr_disable();
-	while (atomic_cas_ptr(&p->lock, NULL, ci) != 0)
+	while (atomic_cas_ptr(&p->lock, NULL, ci) != 0) {
 		CPU_BUSY_CYCLE();
+		LOCKSTAT_INC(LS_BUCKET_SPINS);
+	}
 	membar_enter_after_atomic();
+	LOCKSTAT_INC(LS_BUCKET);
+	trace(TRACE_BUCKET, p);
 
 	return (m);
 }
@@ -112,23 +117,28 @@ mtx_enter(struct mutex *mtx)
 	unsigned long owner;
 	unsigned int i;
 	unsigned long m;
-	int cond;
+	int cond, parked = 0, woken = 0;
 
 	/* Extra bit from the Spinning section after Barging */
 
 	/* Fast path: */
-	if (atomic_cas_ulong(&mtx->mtx_owner, 0, self) == 0)
+	if (atomic_cas_ulong(&mtx->mtx_owner, 0, self) == 0) {
+		LOCKSTAT_INC(LS_FAST);
 		goto locked;
+	}
 
-	for (i = 40; i--;) {
+	for (i = spin_counts[SPIN_MEDIUM]; i--;) {
 		/* Do not spin if there is a queue. */
 		owner = mtx->mtx_owner;
 		if (owner & MTX_HASPARKED)
 			break;
 		/* Try to get the lock. */
-		if (atomic_cas_ulong(&mtx->mtx_owner, 0, self) == 0)
+		if (atomic_cas_ulong(&mtx->mtx_owner, 0, self) == 0) {
+			LOCKSTAT_INC(LS_SPIN);
 			goto locked;
+		}
 		CPU_BUSY_CYCLE();
+		LOCKSTAT_INC(LS_SPINS);
 	}
 
 	p = mtx_park(mtx);
@@ -142,8 +152,15 @@ mtx_enter(struct mutex *mtx)
 		 */
 		if (!ISSET(owner, MTX_ISLOCKED)) {
 			if (atomic_cas_ulong(&mtx->mtx_owner,
-			    owner, owner | self) == owner)
+			    owner, owner | self) == owner) {
+				LOCKSTAT_INC(parked ? LS_PARK : LS_SPIN);
 				break;
+			}
+		}
+		if (woken) {
+			/* someone barged in while we were being woken */
+			LOCKSTAT_INC(LS_STEAL);
+			woken = 0;
 		}
 
 		/*
@@ -173,8 +190,13 @@ mtx_enter(struct mutex *mtx)
 		mtx_leave_park(p, m);
 
 		if (cond) {
-			while (w.mtx != NULL)
+			trace(TRACE_PARK, mtx);
+			while (w.mtx != NULL) {
 				CPU_BUSY_CYCLE();
+				LOCKSTAT_INC(LS_PARK_SPINS);
+			}
+			trace(TRACE_UNPARK, mtx);
+			parked = woken = 1;
 		}
 	}
 locked:
@@ -202,12 +224,16 @@ mtx_leave(struct mutex *mtx)
 			abort();
 		}
 
+		LOCKSTAT_INC(LS_LEAVE_SLOW);
+
 		/* Fast unlocking failed, so unpark a thread. */
 		p = mtx_park(mtx);
 		m = mtx_enter_park(p);
 		TAILQ_FOREACH(w, &p->waiters, entry) {
 			if (w->mtx == mtx) {
 				TAILQ_REMOVE(&p->waiters, w, entry);
+				LOCKSTAT_INC(LS_HANDOFF);
+				trace(TRACE_WAKE, mtx);
 				w->mtx = NULL;
 				break;
 			}